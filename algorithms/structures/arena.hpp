@@ -0,0 +1,394 @@
+#pragma once
+
+#include <includes/header.hpp>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Pointer stored as the distance from its own address. Structures whose parts point to each other
+// this way may live in a single buffer, which then can be moved or copied byte-wise as a whole.
+template<class T>
+class ArenaPtr {
+ public:
+  ArenaPtr() = default;
+  ArenaPtr(T* p) { reset(p); }
+  ArenaPtr(const ArenaPtr& other) { reset(other.get()); }
+  ArenaPtr& operator=(const ArenaPtr& other) { reset(other.get()); return *this; }
+
+  T* get() const { return off_ ? reinterpret_cast<T*>(reinterpret_cast<intptr_t>(this) + off_) : nullptr; }
+  T& operator[](size_t i) const { return reinterpret_cast<T*>(reinterpret_cast<intptr_t>(this) + off_)[i]; }
+  T& operator*() const { return *get(); }
+  T* operator->() const { return get(); }
+  explicit operator bool() const { return off_ != 0; }
+
+ private:
+  void reset(T* p) {
+    off_ = p ? reinterpret_cast<intptr_t>(p) - reinterpret_cast<intptr_t>(this) : 0;
+  }
+
+  intptr_t off_ = 0;
+};
+
+template<class T>
+class ArenaArray {
+ public:
+  ArenaArray() = default;
+  ArenaArray(T* data, int size) : data_(data), size_(size) {}
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  T* begin() { return data_.get(); }
+  T* end() { return data_.get() + size_; }
+  const T* begin() const { return data_.get(); }
+  const T* end() const { return data_.get() + size_; }
+
+  T& operator[](int i) {  assert(i>=0 && i<size_);
+    return data_[i];
+  }
+  const T& operator[](int i) const {  assert(i>=0 && i<size_);
+    return data_[i];
+  }
+
+ private:
+  ArenaPtr<T> data_;
+  int size_ = 0;
+};
+
+class Arena;
+class ArenaResidentLimit;
+
+// Bump allocator over a slice of an Arena. Every allocation is rounded up to Align, so that sizes
+// computed upfront with bytes() match what the structures take exactly.
+class ArenaRegion {
+ public:
+  static constexpr size_t Align = alignof(max_align_t);
+  static constexpr size_t TouchChunk = 1 << 16;  // Bytes loops filling arrays tell touched() of at once
+
+  template<class T>
+  static size_t bytes(size_t n) {
+    return (n*sizeof(T) + Align-1) / Align * Align;
+  }
+
+  ArenaRegion(Arena* arena, char* begin, char* end) : arena_(arena), at_(begin), end_(end) {}
+
+  size_t left() const { return end_ - at_; }
+
+  // The next `bytes` as a region of its own
+  ArenaRegion carve(size_t bytes) {
+    ArenaRegion r = sub(0, bytes);
+    at_ += bytes;
+    return r;
+  }
+
+  // `bytes` starting `offset` from here, leaving this region as it is. Regions that do not overlap
+  // can be filled from different threads.
+  ArenaRegion sub(size_t offset, size_t bytes) const {  assert(offset % Align == 0);
+    if (left() < offset + bytes) throw bad_alloc();
+    return {arena_, at_ + offset, at_ + offset + bytes};
+  }
+
+  // Raw memory for n objects; nothing is constructed. It counts as touched.
+  template<class T>
+  T* allocate(size_t n);
+
+  // n objects constructed from args, touched a chunk at a time as they are
+  template<class T, class... Args>
+  T* make(size_t n, const Args&... args);
+
+  template<class T>
+  ArenaArray<T> copy(const vector<T>& v) {
+    return copy(v.begin(), v.end());
+  }
+
+  // Also moves, given move_iterators
+  template<class It>
+  ArenaArray<typename iterator_traits<It>::value_type> copy(It first, It last);
+
+  // Tells the ArenaResidentLimit of the arena, if any, that `bytes` at p were touched - written, or
+  // read. Loops touching much of what they did not allocate themselves call it as they go.
+  void touched(const void* p, size_t bytes) const;
+
+ private:
+  template<class T>
+  T* take(size_t n);  // As allocate, touching nothing
+
+  Arena* arena_;
+  char* at_;
+  char* end_;
+};
+
+// One contiguous, zero-initialized buffer holding a whole structure. Arrays of types with
+// non-trivial destructors are tracked, to be destroyed with the arena and copied one by one;
+// everything else is copied byte-wise. The buffer comes from calloc, so large ones are zeroed
+// lazily by the system, page by page, on whichever thread touches them first.
+// An arena with nothing tracked holds no pointers but relative ones, so it may be written to a file
+// and mapped back, anywhere.
+class Arena {
+ public:
+  Arena() = default;
+
+  // `bytes` of the file at path, from `offset` on, mapped privately: pages are read when first
+  // touched and shared, through the page cache, with all the processes mapping the file - until
+  // written to, which copies them. No swap is reserved for the copies upfront, so files larger than
+  // memory and swap may be mapped; only copying more than those hold fails.
+  static Arena map(const string& path, size_t offset, size_t bytes) {  assert(offset % ArenaRegion::Align == 0);
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("Cannot open " + path);
+    struct stat st;
+    const size_t length = offset + bytes;
+    const bool whole = fstat(fd, &st) == 0 && size_t(st.st_size) >= length;
+    void* p = whole ? mmap(nullptr, max<size_t>(length, 1), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (!whole) throw runtime_error("Truncated " + path);
+    if (p == MAP_FAILED) throw runtime_error("Cannot map " + path);
+    Arena arena;
+    arena.size_ = bytes;
+    arena.buffer_ = unique_ptr<char, Release>(static_cast<char*>(p) + offset, Release{offset, max<size_t>(length, 1), false});
+    return arena;
+  }
+
+  // A new file at path of offset + bytes zeros, and `bytes` of it from `offset` on mapped shared:
+  // what is written to the arena is written to the file, by the system, whenever it likes - or by
+  // release(). So the arena may be larger than memory.
+  static Arena create(const string& path, size_t offset, size_t bytes) {  assert(offset % ArenaRegion::Align == 0);
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw runtime_error("Cannot create " + path);
+    const size_t length = max<size_t>(offset + bytes, 1);
+    void* p = ftruncate(fd, length) == 0 ? mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (p == MAP_FAILED) throw runtime_error("Cannot map " + path);
+    Arena arena;
+    arena.size_ = bytes;
+    arena.buffer_ = unique_ptr<char, Release>(static_cast<char*>(p) + offset, Release{offset, length, true});
+    return arena;
+  }
+
+  explicit Arena(size_t bytes)
+  : size_(bytes)
+  , buffer_(static_cast<char*>(calloc(max<size_t>(bytes, 1), 1))) {
+    if (!buffer_) throw bad_alloc();
+  }
+
+  Arena(const Arena& other)
+  : Arena(other.size_) {
+    if (size_) memcpy(data(), other.data(), size_);
+    finalizers_ = other.finalizers_;
+    for (const auto& f : finalizers_)
+      f.copy(data() + f.offset, other.data() + f.offset, f.count);
+  }
+
+  Arena(Arena&& other) noexcept { swap(other); }
+
+  Arena& operator=(Arena other) noexcept {
+    swap(other);
+    return *this;
+  }
+
+  ~Arena() {
+    for (const auto& f : finalizers_)
+      f.destroy(data() + f.offset, f.count);
+  }
+
+  void swap(Arena& other) noexcept {
+    std::swap(size_, other.size_);
+    std::swap(buffer_, other.buffer_);
+    std::swap(finalizers_, other.finalizers_);
+  }
+
+  ArenaRegion region() { return {this, data(), data() + size_}; }
+
+  size_t size() const { return size_; }
+
+  bool tracking() const { return !finalizers_.empty(); }
+
+  bool mapped() const { return buffer_.get_deleter().mapped != 0; }
+
+  // Of an arena made by create: drops all its pages from this process, at once. What was written to
+  // them stays in the page cache, to be written to the file by the system, which bounds how much of
+  // it there is; pages are read back as they are touched again. Safe while other threads write.
+  void release() {  assert(buffer_.get_deleter().shared);
+    const Release& r = buffer_.get_deleter();
+    if (madvise(data() - r.offset, r.mapped, MADV_DONTNEED)) throw runtime_error("Cannot release a mapped arena");
+  }
+
+  // Of an arena made by create: drops the pages overlapping [first, last), as release does
+  void release(const char* first, const char* last) {  assert(buffer_.get_deleter().shared);
+    const Release& r = buffer_.get_deleter();
+    const uintptr_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t begin = max(uintptr_t(first), uintptr_t(data() - r.offset)) / page * page;
+    const uintptr_t end = min(uintptr_t(last), uintptr_t(data() - r.offset + r.mapped));
+    if (begin < end && madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED))
+      throw runtime_error("Cannot release a mapped arena");
+  }
+
+  // Of an arena made by create: whether a fault maps the page touched only, or - as by default -
+  // the large folio or readahead window around it, which for a new file may be megabytes
+  void faultSingly(bool singly) {  assert(buffer_.get_deleter().shared);
+    const Release& r = buffer_.get_deleter();
+    if (madvise(data() - r.offset, r.mapped, singly ? MADV_RANDOM : MADV_NORMAL)) throw runtime_error("Cannot advise a mapped arena");
+  }
+
+  // Of an arena made by create: returns once all that was written to it is in the file
+  void sync() const {  assert(buffer_.get_deleter().shared);
+    const Release& r = buffer_.get_deleter();
+    if (msync(const_cast<char*>(data()) - r.offset, r.mapped, MS_SYNC)) throw runtime_error("Cannot write back a mapped arena");
+  }
+
+  void write(ostream& out) const {  assert(!tracking());
+    out.write(data(), size_);
+  }
+
+  // FNV-1a, over 8-byte words - sizes are multiples of Align. Read in chunks, each touched.
+  uint64_t checksum() const;
+
+  template<class T>
+  T* at(size_t offset) const {  assert(offset < size_);
+    return reinterpret_cast<T*>(const_cast<char*>(data()) + offset);
+  }
+
+  template<class T>
+  void track(T* p, size_t n) {
+    if (is_trivially_destructible<T>::value || !n) return;
+    lock_guard<mutex> lock(trackMutex_);  // Regions may be filled in parallel; order does not matter
+    finalizers_.push_back({size_t(reinterpret_cast<char*>(p) - data()), n, &destroy<T>, &copy<T>});
+  }
+
+ private:
+  struct Finalizer {
+    size_t offset, count;
+    void (*destroy)(char*, size_t);
+    void (*copy)(char*, const char*, size_t);
+  };
+
+  template<class T>
+  static void destroy(char* p, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+      reinterpret_cast<T*>(p)[i].~T();
+  }
+
+  template<class T>
+  static void copy(char* dst, const char* src, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+      new (dst + i*sizeof(T)) T(reinterpret_cast<const T*>(src)[i]);
+  }
+
+  struct Release {  // Frees, or unmaps the mapping the buffer is `offset` into
+    size_t offset, mapped;  // Value-initialized by unique_ptr: zeros
+    bool shared;  // Mapped by create
+    void operator()(char* p) const {
+      if (mapped) munmap(p - offset, mapped);
+      else free(p);
+    }
+  };
+
+  char* data() { return buffer_.get(); }
+  const char* data() const { return buffer_.get(); }
+
+  size_t size_ = 0;
+  unique_ptr<char, Release> buffer_;
+  vector<Finalizer> finalizers_;
+  mutex trackMutex_;  // Not swapped, each arena keeps its own
+  ArenaResidentLimit* limit_ = nullptr;  // Not swapped either: set while one is alive, for this arena
+
+  friend class ArenaRegion;
+  friend class ArenaResidentLimit;
+};
+
+template<class T, class... Args>
+T* ArenaRegion::make(size_t n, const Args&... args) {
+  T* p = take<T>(n);
+  const size_t chunk = max<size_t>(1, TouchChunk / sizeof(T));
+  for (size_t i = 0; i < n; i += chunk) {
+    const size_t end = min(n, i + chunk);
+    for (size_t j = i; j < end; ++j)
+      new (p + j) T(args...);
+    touched(p + i, (end - i) * sizeof(T));
+  }
+  arena_->track(p, n);
+  return p;
+}
+
+template<class It>
+ArenaArray<typename iterator_traits<It>::value_type> ArenaRegion::copy(It first, It last) {
+  using T = typename iterator_traits<It>::value_type;
+  const size_t n = distance(first, last);
+  T* p = allocate<T>(n);
+  for (size_t i = 0; i < n; ++i, ++first)
+    new (p + i) T(*first);
+  arena_->track(p, n);
+  return {p, int(n)};
+}
+
+// While alive, keeps the pages of an arena made by Arena::create resident within about `bytes`, as
+// it is built: everything allocated from its regions counts as touched, as does what touched() is
+// told of. Once more than `bytes` were touched since, the whole arena is released - pages read back
+// without telling go too. What else this process maps counts for nothing. Faults map single pages
+// meanwhile, so that what is touched is what is resident. On top of `bytes`, what is read back, or
+// filled in one go after being allocated, between two releases may be resident.
+class ArenaResidentLimit {
+ public:
+  ArenaResidentLimit(Arena& arena, size_t bytes) : arena_(arena), bytes_(bytes) {  assert(!arena.limit_);
+    arena.limit_ = this;
+    arena.faultSingly(true);
+  }
+
+  ArenaResidentLimit(const ArenaResidentLimit&) = delete;
+  ArenaResidentLimit& operator=(const ArenaResidentLimit&) = delete;
+
+  ~ArenaResidentLimit() {
+    arena_.faultSingly(false);
+    arena_.limit_ = nullptr;
+  }
+
+  void touched(const void* /*p*/, size_t bytes) {
+    lock_guard<mutex> lock(mutex_);  // Regions may be filled in parallel
+    touched_ += bytes;
+    if (touched_ <= bytes_) return;
+    arena_.release();
+    touched_ = 0;
+  }
+
+ private:
+  Arena& arena_;
+  const size_t bytes_;
+  mutex mutex_;
+  size_t touched_ = 0;  // Since the last release
+};
+
+template<class T>
+T* ArenaRegion::allocate(size_t n) {
+  T* p = take<T>(n);
+  touched(p, bytes<T>(n));
+  return p;
+}
+
+template<class T>
+T* ArenaRegion::take(size_t n) {
+  static_assert(alignof(T) <= Align, "T over-aligned");
+  const size_t b = bytes<T>(n);
+  if (left() < b) throw bad_alloc();
+  T* p = reinterpret_cast<T*>(at_);
+  at_ += b;
+  return p;
+}
+
+inline uint64_t Arena::checksum() const {
+  constexpr size_t Chunk = 1 << 20;
+  uint64_t h = 14695981039346656037ull;
+  for (size_t chunk = 0; chunk < size_; chunk += Chunk) {
+    const size_t end = min(size_, chunk + Chunk);
+    for (size_t i = chunk; i < end; i += sizeof(uint64_t)) {
+      uint64_t w;
+      memcpy(&w, data() + i, sizeof(w));
+      h = (h ^ w) * 1099511628211ull;
+    }
+    if (limit_) limit_->touched(data() + chunk, end - chunk);
+  }
+  return h;
+}
+
+inline void ArenaRegion::touched(const void* p, size_t bytes) const {
+  if (arena_->limit_) arena_->limit_->touched(p, bytes);
+}
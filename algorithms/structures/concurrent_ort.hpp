@@ -0,0 +1,34 @@
+#pragma once
+
+#include "algorithms/structures/ort.hpp"
+
+// A tree shared by readers and updated without blocking them. Readers take the current version and
+// query it for as long as they hold it - queries are const, and const methods of ORT never write.
+// Updates are made on a copy of the current version, which is then published atomically; versions
+// no longer held by anyone are freed. Writers are serialized. A copy of ORT is a single memcpy of
+// its arena, so batching many changes into one update() pays for it once.
+template<class Tree>
+class ConcurrentORT {
+ public:
+  explicit ConcurrentORT(Tree tree)
+  : current_(make_shared<const Tree>(std::move(tree)))
+  {}
+
+  shared_ptr<const Tree> get() const {
+    return atomic_load(&current_);
+  }
+
+  // update(Tree&) on a copy of the current version, published once it returns. If it throws, the
+  // current version stays.
+  template<class Update>
+  void update(const Update& update) {
+    lock_guard<mutex> lock(writeMutex_);
+    auto next = make_shared<Tree>(*atomic_load(&current_));
+    update(*next);
+    atomic_store(&current_, shared_ptr<const Tree>(std::move(next)));
+  }
+
+ private:
+  shared_ptr<const Tree> current_;  // Accessed only with atomic_load and atomic_store
+  mutex writeMutex_;
+};
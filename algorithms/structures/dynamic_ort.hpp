@@ -0,0 +1,273 @@
+#pragma once
+
+#include "algorithms/structures/ort.hpp"
+
+// ORT taking inserts and erases, by the logarithmic method: elements are spread over static trees,
+// the i-th of at most 2^i of them. An insert rebuilds the first empty slot out of the ones below it,
+// so every element is rebuilt O(log n) times, amortized. An erase leaves a hole in the tree holding
+// the element; a tree with more holes than elements is rebuilt out of what is left.
+// Queries ask every tree, so they take O(log n) times as long as these of a static ORT, and Mix,
+// mixing results of different trees, should not depend on their order.
+// Copies are versions: trees are shared among them, and marked so for good at the copy. An erase
+// from a tree marked shared leaves a tombstone in this version instead, hiding one element equal to
+// it; past MaxTombstones, the slot is rebuilt out of what is left, as a tree of this version alone.
+// So a snapshot takes O(log n), and a copy of the tombstones, and an update of one version leaves
+// the others as they were - a rollback is an assignment of the snapshot back. Where tombstones lie
+// within [a, b), a tree is queried around them: in slabs cut along its top dimension at each of
+// them, and those at their coordinates are reported - so in O(log^Dim n) per tombstone, not in time
+// linear in the elements within. Different versions may be used by different threads; the trees
+// they share are only read. Trees keep their GSegTrees, to erase from, whatever Mix declares.
+template<size_t Dim, class V, class DimCmp, class Mix, class Trans>
+class DynamicORT {
+  using Tree = ORT<Dim, V, DimCmp, Updatable<Mix>, Trans>;
+  using R = typename ORTResult<V, Mix>::type;
+  using Less = DimLess<DimCmp, Dim-1>;  // Tombstones are sorted by the dimension the trees are
+  using Bound = SlabBound<V, Dim-1>;
+
+ public:
+  // Tombstones a slot takes before it is rebuilt; a query takes O(log^Dim n) for each within [a, b)
+  static constexpr int MaxTombstones = 64;
+
+  explicit DynamicORT(vector<V> initial = {}, unsigned threads = 1)
+  : threads_(threads) {
+    if (initial.empty()) return;
+    int i = 0;
+    while ((size_t(1) << i) < initial.size()) ++i;
+    slots_.resize(i+1);
+    build(i, std::move(initial));
+  }
+
+  DynamicORT(const DynamicORT& other)
+  : threads_(other.threads_), slots_(other.slots_) {
+    share();
+  }
+
+  DynamicORT(DynamicORT&&) = default;
+
+  DynamicORT& operator=(const DynamicORT& other) {
+    threads_ = other.threads_;
+    slots_ = other.slots_;
+    share();
+    return *this;
+  }
+
+  DynamicORT& operator=(DynamicORT&&) = default;
+
+  int size() const {
+    int n = 0;
+    for (const auto& s : slots_)
+      n += s.size - s.erased;
+    return n;
+  }
+
+  void insert(const V& v) {
+    vector<V> elements{v};
+    size_t j = 0;
+    for (; j < slots_.size() && slots_[j].tree; ++j) {
+      alive(slots_[j], [&elements](const V& e) { elements.push_back(e); });
+      slots_[j] = Slot();
+    }
+    if (j == slots_.size()) slots_.emplace_back();
+    build(j, std::move(elements));
+  }
+
+  // Erases one element equal to v, if there is any; false if there is not
+  bool erase(const V& v) {
+    for (size_t i = 0; i < slots_.size(); ++i) {
+      Slot& s = slots_[i];
+      if (!s.tree || !contains(s, v)) continue;
+      const bool shared = s.tree->shared;
+      if ((s.erased + 1) * 2 > s.size || (shared && int(s.tombstones.size()) == MaxTombstones)) {
+        // Rebuilt, leaving the old tree as it is
+        vector<V> elements;
+        bool skipped = false;
+        alive(s, [&](const V& e) {
+          if (!skipped && e == v) skipped = true;
+          else elements.push_back(e);
+        });
+        s = Slot();
+        if (!elements.empty()) build(i, std::move(elements));
+        return true;
+      }
+      ++s.erased;
+      if (shared)
+        s.tombstones.insert(upper_bound(s.tombstones.begin(), s.tombstones.end(), v, Less{}), v);
+      else
+        s.tree->tree.erase(v);
+      return true;
+    }
+    return false;
+  }
+
+  bool contains(const V& v) const {
+    for (const auto& s : slots_)
+      if (s.tree && contains(s, v)) return true;
+    return false;
+  }
+
+  template<class Debugger>
+  R query(const V& a, const V& b, bool& any, Debugger& debugger) const {
+    any = false;
+    R v{};
+    for (const auto& s : slots_) {
+      if (!s.tree) continue;
+      bool any_rec = false;
+      R rv = hides(s, a, b) ? queryAround(s, a, b, any_rec, debugger) : s.tree->tree.query(a, b, any_rec, debugger);
+      if (any_rec) {
+        v = !any ? any=true, rv : Mix{}(std::move(v), std::move(rv));
+      }
+    }
+    return v;
+  }
+
+  R query(const V& a, const V& b, bool& any) const {
+    ORTEmptyDebugger<V> debugger;
+    return query(a, b, any, debugger);
+  }
+
+  template<class Fn>
+  bool report(const V& a, const V& b, Fn fn) const {
+    for (const auto& s : slots_) {
+      if (!s.tree) continue;
+      if (!hides(s, a, b)) {
+        if (!s.tree->tree.report(a, b, std::ref(fn))) return false;
+        continue;
+      }
+      Hidden hidden(s.tombstones);
+      if (!s.tree->tree.report(a, b, [&](const V& e) { return hidden(e) || fn(e); })) return false;
+    }
+    return true;
+  }
+
+  template<class Fn>
+  void alive(const Fn& fn) const {
+    for (const auto& s : slots_)
+      if (s.tree) alive(s, fn);
+  }
+
+  // Of all the trees, holes included, and of the tombstones
+  size_t bytes() const {
+    size_t bytes = 0;
+    for (const auto& s : slots_)
+      if (s.tree) bytes += s.tree->tree.bytes() + s.tombstones.size() * sizeof(V);
+    return bytes;
+  }
+
+  // Of the trees shared with another version
+  size_t bytesSharedWith(const DynamicORT& other) const {
+    size_t bytes = 0;
+    for (const auto& s : slots_)
+      for (const auto& o : other.slots_)
+        if (s.tree && s.tree == o.tree) bytes += s.tree->tree.bytes();
+    return bytes;
+  }
+
+ private:
+  // A tree, and whether another version may hold it too - set when a version holding it is copied,
+  // and never reset, so that a version seeing it clear is the only one that can reach the tree
+  struct Held {
+    template<class... Args>
+    explicit Held(Args&&... args) : tree(std::forward<Args>(args)...) {}
+
+    Tree tree;
+    atomic<bool> shared{false};
+  };
+
+  struct Slot {
+    shared_ptr<Held> tree;
+    int size = 0, erased = 0;  // Tombstones included
+    vector<V> tombstones;      // Erased from this version only, sorted by Less
+  };
+
+  // Whether an element is hidden by a tombstone, each hiding one - so the first of its equal ones seen
+  class Hidden {
+   public:
+    explicit Hidden(const vector<V>& tombstones)
+    : tombstones_(tombstones), used_(tombstones.size()) {}
+
+    bool operator()(const V& e) {
+      auto range = equal_range(tombstones_.begin(), tombstones_.end(), e, Less{});
+      for (auto it = range.first; it != range.second; ++it) {
+        const size_t t = it - tombstones_.begin();
+        if (!used_[t] && *it == e) return used_[t] = true;
+      }
+      return false;
+    }
+
+   private:
+    const vector<V>& tombstones_;
+    vector<bool> used_;
+  };
+
+  // Whether s has an element equal to v, not hidden
+  static bool contains(const Slot& s, const V& v) {
+    if (!s.tree->tree.contains(v)) return false;
+    auto range = equal_range(s.tombstones.begin(), s.tombstones.end(), v, Less{});
+    const int hidden = count(range.first, range.second, v);
+    return hidden == 0 || s.tree->tree.copies(v) > hidden;
+  }
+
+  // Whether a tombstone of s lies within [a, b)
+  static bool hides(const Slot& s, const V& a, const V& b) {
+    auto first = lower_bound(s.tombstones.begin(), s.tombstones.end(), a, Less{});
+    auto last = lower_bound(first, s.tombstones.end(), b, Less{});
+    return any_of(first, last, [&](const V& t) { return WithinDims<DimCmp, 0, Dim-1>::check(t, a, b); });
+  }
+
+  // Mix of the elements of s within [a, b), but the hidden ones. [a, b) is cut along the top
+  // dimension at every tombstone within: slabs between the cuts are queried, and the ones at the
+  // cuts - a single coordinate there, holding the tombstones and the elements they hide - reported.
+  template<class Debugger>
+  static R queryAround(const Slot& s, const V& a, const V& b, bool& any, Debugger& debugger) {
+    any = false;
+    R v{};
+    auto mix = [&](R r) { v = !any ? any=true, std::move(r) : Mix{}(std::move(v), std::move(r)); };
+    Hidden hidden(s.tombstones);
+    auto visit = [&](const V& e) {
+      if (!hidden(e)) mix(ORTResult<V, Mix>::of(e));
+      return true;
+    };
+    const Tree& tree = s.tree->tree;
+    const V* from = &a;  // The next slab starts at from in the top dimension, or right above it, if cut
+    bool cut = false;
+    auto first = lower_bound(s.tombstones.begin(), s.tombstones.end(), a, Less{});
+    auto last = lower_bound(first, s.tombstones.end(), b, Less{});
+    for (auto t = first; t != last; ++t) {
+      if (!WithinDims<DimCmp, 0, Dim-1>::check(*t, a, b) || (cut && !Less{}(*from, *t))) continue;
+      bool slabAny;
+      R slab = tree.query(Bound{a, *from, cut}, Bound{b, *t, false}, slabAny, debugger);
+      if (slabAny) mix(std::move(slab));
+      tree.report(Bound{a, *t, false}, Bound{b, *t, true}, visit);
+      from = &*t;
+      cut = true;
+    }
+    bool slabAny;
+    R slab = tree.query(Bound{a, *from, cut}, Bound{b, b, false}, slabAny, debugger);
+    if (slabAny) mix(std::move(slab));
+    return v;
+  }
+
+  template<class Fn>
+  static void alive(const Slot& s, const Fn& fn) {
+    if (s.tombstones.empty()) return s.tree->tree.alive(fn);
+    Hidden hidden(s.tombstones);
+    s.tree->tree.alive([&](const V& e) { if (!hidden(e)) fn(e); });
+  }
+
+  void build(size_t i, vector<V> elements) {  assert(!elements.empty()); assert(elements.size() <= (size_t(1) << i));
+    Slot& s = slots_[i];
+    s.size = elements.size();
+    s.erased = 0;
+    s.tombstones.clear();
+    s.tree = make_shared<Held>(std::move(elements), threads_);
+  }
+
+  // Marks the trees of this version shared, once it is copied
+  void share() {
+    for (auto& s : slots_)
+      if (s.tree) s.tree->shared = true;
+  }
+
+  unsigned threads_;
+  vector<Slot> slots_;
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <includes/header.hpp>
+
+// Number of elements in a file of them, written byte-wise one after another
+template<class V>
+size_t elementsIn(const string& path) {
+  ifstream in(path, ios::binary | ios::ate);
+  if (!in) throw runtime_error("Cannot read " + path);
+  const size_t bytes = in.tellg();
+  if (bytes % sizeof(V)) throw runtime_error("Truncated " + path);
+  return bytes / sizeof(V);
+}
+
+// Merges the sorted runs at runs[first, last) into out(v), each run read through `share` elements
+// at a time
+template<class V, class Less, class Out>
+void mergeRuns(const vector<string>& runs, size_t first, size_t last, size_t share, const Out& out) {
+  struct Reader {
+    ifstream in;
+    vector<V> buffer;
+    size_t at = 0;
+
+    bool next(size_t share) {  // Moves on to the next element; false at the end of the run
+      if (++at < buffer.size()) return true;
+      buffer.resize(share);
+      in.read(reinterpret_cast<char*>(buffer.data()), share * sizeof(V));
+      buffer.resize(in.gcount() / sizeof(V));
+      at = 0;
+      return !buffer.empty();
+    }
+  };
+  vector<Reader> readers(last - first);
+  auto later = [&readers](int r1, int r2) {  // A heap of the runs, by their current elements
+    return Less{}(readers[r2].buffer[readers[r2].at], readers[r1].buffer[readers[r1].at]);
+  };
+  vector<int> heap;
+  for (size_t r = 0; r < readers.size(); ++r) {
+    readers[r].in.open(runs[first + r], ios::binary);
+    if (!readers[r].in) throw runtime_error("Cannot read " + runs[first + r]);
+    readers[r].at = size_t(-1);
+    if (readers[r].next(share)) heap.push_back(r);
+  }
+  make_heap(heap.begin(), heap.end(), later);
+  while (!heap.empty()) {
+    pop_heap(heap.begin(), heap.end(), later);
+    Reader& reader = readers[heap.back()];
+    out(reader.buffer[reader.at]);
+    if (reader.next(share)) push_heap(heap.begin(), heap.end(), later);
+    else heap.pop_back();
+  }
+}
+
+// Sorts a file of elements, as elementsIn reads them, holding at most about `memory` bytes of them
+// at once: sorted runs of that many go to files at scratch + ".runI", then are merged, fanIn at a
+// time - into new runs, over as many passes as it takes - each read through its share of `memory`.
+// A file that fits is sorted in memory. out(v) gets them in order; runs are removed once merged.
+// Returns how many elements there were.
+template<class V, class Less, class Out>
+size_t externalSort(const string& input, const string& scratch, size_t memory, const Out& out, size_t fanIn = 64) {
+  static_assert(is_trivially_copyable<V>::value, "Only trivially copyable elements can be read from a file");
+  assert(fanIn >= 2);
+  struct Runs : vector<string> {
+    ~Runs() { for (const string& run : *this) remove(run.c_str()); }
+  } runs;
+
+  const size_t chunk = max<size_t>(1, memory / sizeof(V));
+  ifstream in(input, ios::binary);
+  if (!in) throw runtime_error("Cannot read " + input);
+  size_t n = 0;
+  {
+    vector<V> buffer;
+    for (;;) {
+      buffer.resize(chunk);
+      in.read(reinterpret_cast<char*>(buffer.data()), chunk * sizeof(V));
+      const size_t bytes = in.gcount();
+      if (bytes % sizeof(V)) throw runtime_error("Truncated " + input);
+      buffer.resize(bytes / sizeof(V));
+      if (buffer.empty()) break;
+      n += buffer.size();
+      sort(buffer.begin(), buffer.end(), Less{});
+      if (runs.empty() && in.peek() == EOF) {
+        for (const V& v : buffer) out(v);
+        return n;
+      }
+      runs.push_back(scratch + ".run" + to_string(runs.size()));
+      ofstream run(runs.back(), ios::binary | ios::trunc);
+      run.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(V));
+      if (!run.flush()) throw runtime_error("Cannot write " + runs.back());
+    }
+  }
+
+  // Runs [first, runs.size()) are those of the current pass; merged ones are removed as they go
+  const size_t share = max<size_t>(1, chunk / (fanIn + 1));  // And one for the run being written
+  size_t first = 0;
+  while (runs.size() - first > fanIn) {
+    const size_t last = runs.size();
+    for (size_t from = first; from < last; from += fanIn) {
+      const size_t to = min(last, from + fanIn);
+      runs.push_back(scratch + ".run" + to_string(runs.size()));
+      ofstream run(runs.back(), ios::binary | ios::trunc);
+      vector<V> buffer;
+      buffer.reserve(share);
+      auto flush = [&] {
+        run.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(V));
+        buffer.clear();
+      };
+      mergeRuns<V, Less>(runs, from, to, share, [&](const V& v) {
+        buffer.push_back(v);
+        if (buffer.size() == share) flush();
+      });
+      flush();
+      if (!run.flush()) throw runtime_error("Cannot write " + runs.back());
+      for (size_t r = from; r < to; ++r)
+        remove(runs[r].c_str());
+    }
+    first = last;
+  }
+  mergeRuns<V, Less>(runs, first, runs.size(), max<size_t>(1, chunk / (runs.size() - first)), out);
+  return n;
+}
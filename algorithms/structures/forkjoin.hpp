@@ -0,0 +1,95 @@
+#pragma once
+
+#include <includes/header.hpp>
+
+// Runs pairs of independent tasks, handing one of them to another thread while fewer than
+// `threads` are busy. The other threads are started once, with the ForkJoin, and wait for tasks
+// until it is destroyed. Forks nest, so a thread that took a task may fork again, and whichever
+// thread gets free first takes the next large enough task. Tasks smaller than grain never leave
+// the calling thread. With threads == 1 no thread is started and everything runs serially, in order.
+class ForkJoin {
+ public:
+  explicit ForkJoin(unsigned threads = 1, int grain = 1<<12)
+  : grain_(grain), free_(max(1u, threads) - 1) {
+    for (int i = free_; i--;)
+      workers_.emplace_back([this] { work(); });
+  }
+
+  ForkJoin(const ForkJoin&) = delete;
+  ForkJoin& operator=(const ForkJoin&) = delete;
+
+  ~ForkJoin() {
+    {
+      lock_guard<mutex> lock(mutex_);
+      stop_ = true;
+    }
+    ready_.notify_all();
+    for (thread& worker : workers_)
+      worker.join();
+  }
+
+  template<class F, class G>
+  void operator()(int size, const F& f, const G& g) const {
+    if (size < grain_ || !take()) {
+      f();
+      g();
+      return;
+    }
+
+    Task task{[](const void* f) { (*static_cast<const F*>(f))(); }, &f};
+    {
+      lock_guard<mutex> lock(mutex_);
+      tasks_.push_back(&task);
+    }
+    ready_.notify_one();
+    try { g(); } catch (...) { wait(task); throw; }
+    wait(task);
+    if (task.error) rethrow_exception(task.error);
+  }
+
+ private:
+  struct Task {
+    void (*run)(const void* f);
+    const void* f;
+    exception_ptr error = nullptr;
+    bool done = false;
+  };
+
+  bool take() const {
+    int n = free_.load();
+    while (n > 0)
+      if (free_.compare_exchange_weak(n, n-1)) return true;
+    return false;
+  }
+
+  void wait(const Task& task) const {
+    unique_lock<mutex> lock(mutex_);
+    done_.wait(lock, [&task] { return task.done; });
+  }
+
+  void work() const {
+    for (;;) {
+      unique_lock<mutex> lock(mutex_);
+      ready_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+      if (tasks_.empty()) return;
+      Task* task = tasks_.front();
+      tasks_.pop_front();
+      lock.unlock();
+      try { task->run(task->f); } catch (...) { task->error = current_exception(); }
+      lock.lock();
+      task->done = true;
+      free_++;
+      lock.unlock();
+      done_.notify_all();
+    }
+  }
+
+  const int grain_;
+  mutable atomic<int> free_;  // Workers not running a task, less the ones it is being handed to
+  mutable mutex mutex_;
+  mutable condition_variable ready_;  // Of tasks_, or stop_
+  mutable condition_variable done_;  // Of some Task::done
+  mutable deque<Task*> tasks_;
+  bool stop_ = false;
+  vector<thread> workers_;
+};
@@ -1,6 +1,45 @@
+#pragma once
+
 #include <includes/header.hpp>
+#include "algorithms/structures/arena.hpp"
+#include "algorithms/structures/forkjoin.hpp"
+
+// A vector of at most N elements, kept in place - on the stack, for locals
+template<class T, int N>
+class InlineVector {
+ public:
+  void push_back(const T& v) {  assert(size_ < N);
+    data_[size_++] = v;
+  }
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+  reverse_iterator<const T*> rbegin() const { return reverse_iterator<const T*>(end()); }
+  reverse_iterator<const T*> rend() const { return reverse_iterator<const T*>(begin()); }
+
+ private:
+  T data_[N];
+  int size_ = 0;
+};
+
+// Where the bytes a tree takes from its region go
+struct GSegTreeLayout {
+  size_t nodes = 0;    // Slots, the unused ones included
+  size_t values = 0;   // Bytes of the values at the nodes
+  size_t trans = 0;    // Of pending updates
+  size_t holes = 0;
+  size_t padding = 0;  // Of the slots past the last element, or never filled - part of the above
+};
 
-template<class V, class Trans>
+// Trans declaring `static constexpr bool neutralOnly = true` is never anything but neutral, so trees
+// of it keep no Trans at their nodes
+template<class Trans, class = void> struct IsNeutralOnly : false_type {};
+template<class Trans> struct IsNeutralOnly<Trans, enable_if_t<Trans::neutralOnly>> : true_type {};
+
+// Mix is a stateless functor, made whenever needed - like DimCmp of ORT.
+// Trees with Holes = false are never erased from, and keep no holes.
+template<class V, class Mix, class Trans, bool Holes = true>
 struct GSegTree {
   // Assumes that:
   // Mix(a, Mix(b, c)) == Mix(Mix(a, b), c)
@@ -10,98 +49,199 @@ struct GSegTree {
   // V is default constructible
   // V is movable
   // V is copy-constructible
-  GSegTree(vector<V> initial, function<V(const V&, const V&)> mix)
-  : S(initial.size()), Mix(mix) {  assert(!initial.empty()); assert(mix);
+
+  // Trans is a lazy update of a range of leaves, kept at the nodes covering it:
+  // V combine(V v, int len)    - v, a node of len leaves, with the update done
+  // void apply(V* v, int dx)   - the update done on the leaf dx from the start of the range
+  // void compose(Trans* t)     - *t followed by this update, stored in *t
+  // Trans move(int dx, int dl) - this update as seen by a range starting dx later, dl longer
+  // static Trans neutral(), bool isNeutral()
+  
+  // The tree itself is just a header, its nodes are allocated from the region
+  GSegTree(vector<V> initial, ArenaRegion& region)
+  : GSegTree(initial.size(), region, [&initial](int i) { return std::move(initial[i]); })
+  {}
+
+  // Leaves are given by leaf(i), for every i < s, in order
+  template<class Leaf>
+  GSegTree(int s, ArenaRegion& region, const Leaf& leaf)
+  : GSegTree(s, region, leaf, [](int /*x*/, const V& l, const V& r) { return mix(l, r); }, ForkJoin{})
+  {}
+
+  // Built bottom-up: leaf(i) gives leaf i, make(x, l, r) gives node x out of its children.
+  // Sibling subtrees are built through fork(size, left, right), so possibly in parallel.
+  template<class Leaf, class Make, class Fork>
+  GSegTree(int s, ArenaRegion& region, const Leaf& leaf, const Make& make, const Fork& fork)
+  : S(s), SR(leavesFor(S)) {  assert(s > 0);
     static_assert(is_default_constructible<V>::value, "V def-con");
-    SR = 1 << (__builtin_clz(1) - __builtin_clz((S - 1) | 1) + 1);
-    D = vector<V>(SR*2);  // Assuming V is default-constructible
-    T = vector<Trans>(SR, Trans::neutral());    
-    
-    move(initial.begin(), initial.end(), D.begin() + SR);
-    for (int i = SR; --i>0;) 
-      if (valid(i))  // This enforces neutral-correctness
-        D[i] = Mix(D[i*2], D[i*2+1]);
+    D = region.make<V>(SR*2);  // Assuming V is default-constructible
+    if (!NeutralOnly) T = region.make<Trans>(SR, Trans::neutral());
+    if (Holes) H = region.make<uint8_t>(SR*2);
+    build(1, leaf, make, fork);
   } 
   
-  GSegTree(const GSegTree&) = delete; 
-  GSegTree& operator=(const GSegTree&) = delete;
+  GSegTree() = default;
+  
+  // Bytes taken from the region by a tree of s elements
+  static size_t footprint(int s) {
+    const int sr = leavesFor(s);
+    return ArenaRegion::bytes<V>(sr*2) + (NeutralOnly ? 0 : ArenaRegion::bytes<Trans>(sr))
+                                       + (Holes ? ArenaRegion::bytes<uint8_t>(sr*2) : 0);
+  }
   
-  GSegTree(const GSegTree& other, function<V(const V&, const V&)> mix)
-  : S(other.S)
-  , SR(other.SR)
-  , D(other.D)
-  , T(other.T)
-  , Mix(mix)
-  {
-    assert(mix);
+  static int leavesFor(int s) {
+    return 1 << (__builtin_clz(1) - __builtin_clz((s - 1) | 1) + 1);
+  }
+
+  // Of footprint(s); leaves are rounded up to a power of two, slot 0 is never used
+  static GSegTreeLayout layout(int s) {
+    const int sr = leavesFor(s);
+    int used = 0;
+    for (int len = 1; len <= sr; len *= 2)
+      used += (s + len-1) / len;
+    GSegTreeLayout l;
+    l.nodes = sr*2;
+    l.values = ArenaRegion::bytes<V>(sr*2);
+    l.trans = NeutralOnly ? 0 : ArenaRegion::bytes<Trans>(sr);
+    l.holes = Holes ? ArenaRegion::bytes<uint8_t>(sr*2) : 0;
+    l.padding = (sr*2 - used) * (sizeof(V) + (Holes ? sizeof(uint8_t) : 0))
+              + (NeutralOnly ? 0 : (sr - (used - s)) * sizeof(Trans));
+    return l;
   }
   
   int size() const { return S; }
   
-  void assertValid() const { assert(size()>0); assert(Mix); }
+  void assertValid() const { assert(size()>0); assert(D); }
  
+  // Const methods never write, pending Trans are followed, not pushed down: any number of threads
+  // may query a tree at once, as long as none of them updates it.
+
+  // V{} if all of [a, b] is erased
   V query(int a, int b) const {  assert(a>=0); assert(a<S);
-                                 assert(b>=0); assert(b<S);
-                                 assert(a<=b);
-    assert(Mix);
-    const auto cq = bases(a, b).cq;
-    assert(!cq.empty());
-    auto it = cq.begin();
-    assert(*it >= SR);
-    V v(D[*(it++)]);
-    
-    for (; it != cq.end(); ++it){ 
-      if (*it < SR) {
-        v = Mix(v, T[*it].combine(D[*it], rl(*it)));
-      } else {        
-        v = Mix(v, D[*it]);
-      }
-    }
+                                assert(b>=0); assert(b<S);
+                                assert(a<=b);
+    bool any = false;
+    V v{};
+    queryCustom(a, b, [&v, &any](const V& w, int /*ra*/, int /*rb*/) {
+      v = any ? mix(v, w) : w;
+      any = true;
+    });
     return v;
   }
   
-  void queryCustom(int a, int b, const function<void(const V&, int /*ra*/, int /*rb*/)>& fn) const {
-    assert(Mix);
-    for (int x : bases(a, b).cq)
-      fn(D[x], ra(x), rb(x));
+  // fn(value, ra, rb) for every base interval of [a, b], in order, but the erased ones
+  template<class Fn>
+  void queryCustom(int a, int b, const Fn& fn) const {  assert(a>=0); assert(a<=b); assert(b<S);
+    queryCustom(1, a, b, Trans::neutral(), fn);
+  }
+
+  // Makes a hole of leaf i: it is skipped by queries from now on, and nodes above are mixed anew
+  // of what is left. Nodes of holes only are holes as well.
+  void erase(int i) {  assert(i>=0); assert(i<S); assert(!erased(i));
+    static_assert(Holes, "a tree with no holes is never erased from");
+    push(bases(i, i));  // Nothing is pending above i any more
+    H[SR+i] = 1;
+    for (int x = (SR+i)/2; x > 0 && valid(x); x /= 2)
+      remix(x);
+  }
+
+  bool erased(int i) const {  assert(i>=0); assert(i<S);
+    return hole(SR+i);
+  }
+
+  // fn(value) for leaf i and every valid node above it, bottom-up
+  template<class Fn>
+  void path(int i, const Fn& fn) {  assert(i>=0); assert(i<S);
+    for (int x = SR+i; x > 0 && valid(x); x /= 2)
+      fn(D[x]);
+  }
+
+  // Top-down walk to the base intervals of [a, b], in order, carrying a state along the path.
+  // down(x, s, c) gives the state of the c-th child of node x; subtrees with s.empty() are skipped.
+  template<class St, class Down, class Fn>
+  void descend(int a, int b, const St& s, const Down& down, const Fn& fn) const {  assert(a>=0); assert(a<=b); assert(b<S);
+    descend(1, a, b, s, down, fn);
+  }
+
+  // fn(node, ra, rb) for every valid node with its interval intersecting [a, b], top-down.
+  // Nodes are given as they are: for trees that keep their Trans neutral.
+  template<class Fn>
+  void overlapping(int a, int b, const Fn& fn) {  assert(a>=0); assert(a<=b); assert(b<S);
+    overlapping(1, a, b, fn);
+  }
+
+  int leaves() const { return SR; }
+
+  // Node x, numbered as in a heap; only nodes covering whole intervals within [0, size) are valid
+  const V& node(int x) const {  assert(valid(x));
+    return D[x];
   }
   
+  // Updates leaves [a, b] lazily: only the base intervals get trans, and their ancestors are mixed anew
   void apply(int a, int b, Trans trans) {  assert(a>=0); assert(a<S);
-                                           assert(b>=0); assert(b<S);
-                                           assert(a<=b);       
-    auto ba = bases(a, b);    
+                                          assert(b>=0); assert(b<S);
+                                          assert(a<=b);
+    const auto ba = bases(a, b);
+    push(ba);
     for (int x : ba.cq) {
-      if (x < SR) 
-        T[x] = trans.move(ra(x)-a, rl(x)-(b-a+1)).compose(T[x]);
-      else 
-        D[x] = trans.apply(D[x], ra(x)-a);
-    }
-    
-    for (int x : ba.pq) {
-      if (x < SR/2)
-        D[x] = Mix(T[x*2  ].combine(D[x*2  ], rl(x*2  )),
-                   T[x*2+1].combine(D[x*2+1], rl(x*2+1)));
-      else  // if (x < SR)
-        D[x] = Mix(D[x*2], D[x*2+1]);
+      if (x < SR)
+        trans.move(ra(x)-a, rl(x)-(b-a+1)).compose(&T[x]);
+      else
+        trans.apply(&D[x], ra(x)-a);
     }
+
+    for (int x : ba.pq)
+      remix(x);
   }
   
-  pair<typename vector<V>::const_iterator, typename vector<V>::const_iterator> getAll() const {
-    return {D.begin() + SR, D.begin() + SR + S};
-  }
-  
-  void resetMix(function<V(const V&, const V&)> mix) {
-    Mix = mix;
+  pair<const V*, const V*> getAll() const {
+    return {D.get() + SR, D.get() + SR + S};
   }
   
  private:
-  struct B { vector<int> pq, cq; };
+  static constexpr bool NeutralOnly = IsNeutralOnly<Trans>::value;
+
+  static V mix(const V& l, const V& r) {
+    return Mix{}(l, r);
+  }
+
+  bool neutral(int x) const { return NeutralOnly || T[x].isNeutral(); }  // Nothing pending at node x < SR
+  bool hole(int x) const { return Holes && H[x]; }
+
+  // Of node x, with what is pending at it. Neutral Trans are never called, so Trans with nothing
+  // to do, like EmptyTrans, may assert that they are not.
+  V value(int x) const {
+    return x < SR && !neutral(x) ? T[x].combine(D[x], rl(x)) : D[x];
+  }
+
+  // Of node x, with what is pending at it and above it, as seen by x
+  V value(int x, Trans pending) const {
+    if (pending.isNeutral()) return value(x);
+    if (x >= SR) {
+      V v = D[x];
+      pending.apply(&v, 0);
+      return v;
+    }
+    Trans t = T[x];
+    pending.compose(&t);
+    return t.combine(D[x], rl(x));
+  }
+
+  void remix(int x) {  assert(x < SR); assert(valid(x));  // Node x anew, out of its children
+    if (Holes) H[x] = H[x*2] && H[x*2+1];
+    if (!hole(x))
+      D[x] = hole(x*2) ? value(x*2+1) : hole(x*2+1) ? value(x*2) : mix(value(x*2), value(x*2+1));
+  }
+
+  // At most two nodes per depth; depth is below the number of bits of int
+  static constexpr int MaxBases = 2 * numeric_limits<int>::digits;
+  struct B { InlineVector<int, MaxBases> pq, cq; };
   
   B bases(int a, int b) const {  assert(a>=0); assert(a<=b); assert(b<S);
     B ba;
     auto& pq = ba.pq;
     auto& cq = ba.cq;  // In proper order (inorder)
-    vector<int> rcq;    
+    InlineVector<int, MaxBases/2+1> rcq;
 
     int u = a+SR, v = b+SR;
     cq.push_back(u);
@@ -119,13 +259,19 @@ struct GSegTree {
       pq.push_back(u);
     }
 
-    cq.insert(cq.end(), rcq.rbegin(), rcq.rend());
+    for (auto it = rcq.rbegin(); it != rcq.rend(); ++it)
+      cq.push_back(*it);
 
-    // Propagate Trans down and make them all TN
+    return ba;
+  }
+
+  // Propagates Trans down from the parents of the base intervals, and makes them all neutral
+  void push(const B& ba) {
+    const auto& pq = ba.pq;
     bool changed = false;
     for (auto it = pq.rbegin(); it != pq.rend(); ++it) {
       int i = *it;
-      if (T[i].isNeutral()) continue;
+      if (neutral(i)) continue;
       if (i < SR/2) {
         T[i].move(0, -rl(i*2+1)).compose(&T[i*2]);
         T[i].move(rl(i*2), -rl(i*2)).compose(&T[i*2+1]);
@@ -140,10 +286,64 @@ struct GSegTree {
     // Recalculate D upwards
     if (changed)
       for (int x : pq)
-        if (x < SR)
-          D[x] = Mix(D[x*2], D[x*2+1]);
-    
-    return ba;
+        remix(x);
+  }
+
+  // pending: what the ancestors of x have not pushed down, as seen by x
+  template<class Fn>
+  void queryCustom(int x, int a, int b, Trans pending, const Fn& fn) const {
+    if (rb(x) < a || b < ra(x) || hole(x)) return;
+    if (a <= ra(x) && rb(x) <= b) {
+      if (pending.isNeutral() && (x >= SR || neutral(x)))
+        fn(D[x], ra(x), rb(x));
+      else
+        fn(value(x, pending), ra(x), rb(x));
+      return;
+    }
+    if (pending.isNeutral() && neutral(x)) {  // Nothing to move, as for trees never updated
+      queryCustom(x*2,   a, b, pending, fn);
+      queryCustom(x*2+1, a, b, pending, fn);
+      return;
+    }
+    Trans t = T[x];
+    pending.compose(&t);
+    queryCustom(x*2,   a, b, t.move(0, -rl(x*2)), fn);
+    queryCustom(x*2+1, a, b, t.move(rl(x*2), -rl(x*2)), fn);
+  }
+
+  template<class Leaf, class Make, class Fork>
+  void build(int x, const Leaf& leaf, const Make& make, const Fork& fork) {
+    if (ra(x) >= S) return;
+    if (x >= SR) {
+      D[x] = leaf(x-SR);
+      return;
+    }
+    fork(min(rb(x)+1, S) - ra(x),
+      [&, this] { build(x*2,   leaf, make, fork); },
+      [&, this] { build(x*2+1, leaf, make, fork); });
+    if (valid(x))  // This enforces neutral-correctness
+      D[x] = make(x, D[x*2], D[x*2+1]);
+  }
+
+  template<class Fn>
+  void overlapping(int x, int a, int b, const Fn& fn) {
+    if (rb(x) < a || b < ra(x)) return;
+    if (valid(x)) fn(D[x], ra(x), rb(x));
+    if (x >= SR) return;
+    overlapping(x*2,   a, b, fn);
+    overlapping(x*2+1, a, b, fn);
+  }
+
+  template<class St, class Down, class Fn>
+  void descend(int x, int a, int b, const St& s, const Down& down, const Fn& fn) const {
+    if (s.empty() || rb(x) < a || b < ra(x)) return;
+    if (a <= ra(x) && rb(x) <= b) {
+      fn(D[x], ra(x), rb(x), s);
+      return;
+    }
+    assert(neutral(x));  // Nothing is pushed down on the way
+    descend(x*2,   a, b, down(x, s, 0), down, fn);
+    descend(x*2+1, a, b, down(x, s, 1), down, fn);
   }
 
   int rl(int x) const {  assert(x>0 && x < 2*SR);  // Length of an interval pointed by node x
@@ -159,8 +359,8 @@ struct GSegTree {
     return rb(x) < S;
   }
 
-  int S, SR;
-  mutable vector<V> D;
-  mutable vector<Trans> T;
-  function<V(const V&, const V&)> Mix;
+  int S = 0, SR = 0;
+  ArenaPtr<V> D;
+  ArenaPtr<Trans> T;    // None if NeutralOnly
+  ArenaPtr<uint8_t> H;  // Holes: nodes whose leaves are all erased; none if not Holes
 };
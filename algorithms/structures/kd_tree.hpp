@@ -0,0 +1,225 @@
+#pragma once
+
+#include "algorithms/structures/forkjoin.hpp"
+#include "algorithms/structures/ort.hpp"
+
+// Linear-space counterpart of ORT, for when log^(Dim-1) n copies of the elements do not fit: the
+// same queries over [a, b), with the same DimCmp and Mix, in O(n^(1-1/Dim) + k) instead of
+// O(log^Dim n). Elements are kept in a single array, in k-d order: the median of a range by its
+// dimension splits it, and dimensions go in turns down the tree. Ranges of at most Leaf elements are
+// scanned. Every node keeps the mix of its range and its bounding box, as the positions of the least
+// and the greatest element in every dimension, so ranges fully within [a, b) take their mix and ranges
+// out of it are skipped. Static.
+template<size_t Dim, class V, class DimCmp, class Mix>
+class KDTree {
+  using R = typename ORTResult<V, Mix>::type;
+  static constexpr bool Mixed = !is_same<Mix, ReportOnly>::value && !is_same<Mix, CountOnly>::value;
+
+ public:
+  static constexpr int Leaf = 8;
+
+  explicit KDTree(vector<V> initial, unsigned threads = 1)
+  : elements_(std::move(initial))
+  , nodes_(nodesFor(elements_.size()))
+  , values_(Mixed ? nodes_.size() : 0) {  assert(!elements_.empty());
+    if (elements_.size() > size_t(numeric_limits<int>::max())) throw length_error("Too many elements");
+    build(1, 0, elements_.size(), ForkJoin(threads), integral_constant<size_t, 0>{});
+  }
+
+  // Bytes a tree over n elements takes, as bytes() - for V holding no heap memory of its own
+  static size_t footprint(size_t n) {
+    return n * sizeof(V) + nodesFor(n) * (sizeof(Node) + (Mixed ? sizeof(R) : 0));
+  }
+
+  size_t bytes() const {
+    return elements_.size() * sizeof(V) + nodes_.size() * sizeof(Node) + values_.size() * sizeof(R);
+  }
+
+  int size() const { return elements_.size(); }
+
+  R query(const V& a, const V& b, bool& any) const {
+    static_assert(!is_same<Mix, ReportOnly>::value, "ReportOnly trees can only report");
+    any = false;
+    R v{};
+    query(1, 0, elements_.size(), a, b, v, any, integral_constant<size_t, 0>{});
+    return v;
+  }
+
+  // The number of elements within [a, b), for Mix = CountOnly
+  template<class M = Mix, class = enable_if_t<is_same<M, CountOnly>::value>>
+  int query(const V& a, const V& b) const {
+    bool any;
+    return query(a, b, any);
+  }
+
+  // As ORT::report
+  template<class Fn>
+  bool report(const V& a, const V& b, Fn fn) const {
+    return report(1, 0, elements_.size(), a, b, fn, integral_constant<size_t, 0>{});
+  }
+
+  // As the ones above, within a Box, as ORT
+  template<class T>
+  R query(const Box<Dim, T>& box, bool& any) const {
+    static_assert(!is_same<Mix, ReportOnly>::value, "ReportOnly trees can only report");
+    any = false;
+    R v{};
+    query(1, 0, elements_.size(), lowerBound(box), upperBound(box), v, any, integral_constant<size_t, 0>{});
+    return v;
+  }
+
+  template<class T, class M = Mix, class = enable_if_t<is_same<M, CountOnly>::value>>
+  int query(const Box<Dim, T>& box) const {
+    bool any;
+    return query(box, any);
+  }
+
+  template<class T, class Fn>
+  bool report(const Box<Dim, T>& box, Fn fn) const {
+    return report(1, 0, elements_.size(), lowerBound(box), upperBound(box), fn, integral_constant<size_t, 0>{});
+  }
+
+  vector<V> getAll() const {
+    return elements_;
+  }
+
+ private:
+  struct Node {
+    array<int, Dim> lo, hi;  // Positions of the least and the greatest element in every dimension
+  };
+
+  enum Relation { Outside, Inside, Crossing };
+
+  static size_t nodesFor(size_t n) {  // Nodes are numbered as in a heap, from 1
+    return maxNode(1, n) + 1;
+  }
+
+  static size_t maxNode(size_t x, size_t n) {
+    if (n <= size_t(Leaf)) return 0;
+    return max(x, max(maxNode(x*2, n/2), maxNode(x*2+1, n - n/2 - 1)));
+  }
+
+  // The median splits [l, r) in dimension K: [l, m) precede it or tie, [m+1, r) follow it or tie
+  template<size_t K>
+  void build(size_t x, int l, int r, const ForkJoin& fork, integral_constant<size_t, K>) {
+    if (r - l <= Leaf) return;
+    const int m = l + (r-l)/2;
+    nth_element(elements_.begin() + l, elements_.begin() + m, elements_.begin() + r, DimLess<DimCmp, K>{});
+    using Next = integral_constant<size_t, (K+1) % Dim>;
+    fork(r - l,
+      [&] { build(x*2, l, m, fork, Next{}); },
+      [&] { build(x*2+1, m+1, r, fork, Next{}); });
+
+    Node& node = nodes_[x];
+    node.lo.fill(m);
+    node.hi.fill(m);
+    span(x*2, l, m, node);
+    span(x*2+1, m+1, r, node);
+    mix(x, l, m, r, integral_constant<bool, Mixed>{});
+  }
+
+  // Widens node by the box of [l, r), node x if it is one
+  void span(size_t x, int l, int r, Node& node) const {
+    if (r - l > Leaf) {
+      for (int p : nodes_[x].lo) widen(p, node, integral_constant<size_t, 0>{});
+      for (int p : nodes_[x].hi) widen(p, node, integral_constant<size_t, 0>{});
+      return;
+    }
+    for (int p = l; p < r; ++p)
+      widen(p, node, integral_constant<size_t, 0>{});
+  }
+
+  template<size_t D>
+  void widen(int p, Node& node, integral_constant<size_t, D>) const {
+    if (DimCmp{}.template precedes<D>(elements_[p], elements_[node.lo[D]])) node.lo[D] = p;
+    if (DimCmp{}.template precedes<D>(elements_[node.hi[D]], elements_[p])) node.hi[D] = p;
+    widen(p, node, integral_constant<size_t, D+1>{});
+  }
+
+  void widen(int /*p*/, Node& /*node*/, integral_constant<size_t, Dim>) const {}
+
+  void mix(size_t x, int l, int m, int r, true_type) {
+    values_[x] = Mix{}(Mix{}(whole(x*2, l, m), ORTResult<V, Mix>::of(elements_[m])), whole(x*2+1, m+1, r));
+  }
+
+  void mix(size_t /*x*/, int /*l*/, int /*m*/, int /*r*/, false_type) {}
+
+  R whole(size_t x, int l, int r) const {  // Mix of all of [l, r), node x if it is one
+    return whole(x, l, r, integral_constant<bool, is_same<Mix, CountOnly>::value>{});
+  }
+
+  int whole(size_t /*x*/, int l, int r, true_type) const {
+    return r - l;
+  }
+
+  R whole(size_t x, int l, int r, false_type) const {
+    if (r - l > Leaf) return values_[x];
+    R v = ORTResult<V, Mix>::of(elements_[l]);
+    for (int p = l+1; p < r; ++p)
+      v = Mix{}(std::move(v), ORTResult<V, Mix>::of(elements_[p]));
+    return v;
+  }
+
+  template<class B, size_t D>
+  Relation relation(const Node& node, const B& a, const B& b, integral_constant<size_t, D>, bool inside = true) const {
+    const V& lo = elements_[node.lo[D]];
+    const V& hi = elements_[node.hi[D]];
+    if (DimLess<DimCmp, D>{}(hi, a) || !DimLess<DimCmp, D>{}(lo, b)) return Outside;
+    inside = inside && !DimLess<DimCmp, D>{}(lo, a) && DimLess<DimCmp, D>{}(hi, b);
+    return relation(node, a, b, integral_constant<size_t, D+1>{}, inside);
+  }
+
+  template<class B>
+  Relation relation(const Node& /*node*/, const B& /*a*/, const B& /*b*/, integral_constant<size_t, Dim>, bool inside) const {
+    return inside ? Inside : Crossing;
+  }
+
+  void take(R& v, bool& any, R w) const {
+    v = !any ? any=true, std::move(w) : Mix{}(std::move(v), std::move(w));
+  }
+
+  template<class B, size_t K>
+  void query(size_t x, int l, int r, const B& a, const B& b, R& v, bool& any, integral_constant<size_t, K>) const {
+    if (r - l <= Leaf) {
+      for (int p = l; p < r; ++p)
+        if (WithinDims<DimCmp, 0, Dim>::check(elements_[p], a, b)) take(v, any, ORTResult<V, Mix>::of(elements_[p]));
+      return;
+    }
+    const Relation rel = relation(nodes_[x], a, b, integral_constant<size_t, 0>{});
+    if (rel == Outside) return;
+    if (rel == Inside) {
+      take(v, any, whole(x, l, r));
+      return;
+    }
+    const int m = l + (r-l)/2;
+    using Next = integral_constant<size_t, (K+1) % Dim>;
+    query(x*2, l, m, a, b, v, any, Next{});
+    if (WithinDims<DimCmp, 0, Dim>::check(elements_[m], a, b)) take(v, any, ORTResult<V, Mix>::of(elements_[m]));
+    query(x*2+1, m+1, r, a, b, v, any, Next{});
+  }
+
+  template<class B, size_t K, class Fn>
+  bool report(size_t x, int l, int r, const B& a, const B& b, Fn& fn, integral_constant<size_t, K>) const {
+    if (r - l <= Leaf) {
+      for (int p = l; p < r; ++p)
+        if (WithinDims<DimCmp, 0, Dim>::check(elements_[p], a, b) && !fn(elements_[p])) return false;
+      return true;
+    }
+    const Relation rel = relation(nodes_[x], a, b, integral_constant<size_t, 0>{});
+    if (rel == Outside) return true;
+    if (rel == Inside) {
+      for (int p = l; p < r; ++p)
+        if (!fn(elements_[p])) return false;
+      return true;
+    }
+    const int m = l + (r-l)/2;
+    using Next = integral_constant<size_t, (K+1) % Dim>;
+    return report(x*2, l, m, a, b, fn, Next{})
+        && (!WithinDims<DimCmp, 0, Dim>::check(elements_[m], a, b) || fn(elements_[m]))
+        && report(x*2+1, m+1, r, a, b, fn, Next{});
+  }
+
+  vector<V> elements_;  // In k-d order
+  vector<Node> nodes_;
+  vector<R> values_;  // Mix of the range of every node, unless Mix is ReportOnly or CountOnly
+};
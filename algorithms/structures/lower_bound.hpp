@@ -0,0 +1,47 @@
+#pragma once
+
+#include <includes/header.hpp>
+
+// lower_bound with no branch on the comparisons, which are as unpredictable as the keys: the range
+// halves by a conditional move, and the middles of both halves it may go on with are prefetched, so
+// that the misses of consecutive levels overlap
+template<class It, class T, class Less>
+It branchlessLowerBound(It first, It last, const T& value, Less less) {
+  auto n = last - first;
+  if (n == 0) return first;
+  while (n > 1) {
+    const auto half = n / 2;
+    __builtin_prefetch(&first[half/2]);
+    __builtin_prefetch(&first[half + half/2]);
+    first = less(first[half], value) ? first + half : first;
+    n -= half;
+  }
+  return first + less(*first, value);
+}
+
+// Eytzinger order: sorted keys laid out breadth-first in a complete binary tree, the key at k (from 1)
+// having its children at 2k and 2k+1. Rank in sorted order of the key at k, of n: its rank in the
+// perfect tree of as many levels, less the slots of the last level missing before it.
+inline size_t eytzingerRank(size_t k, size_t n) {  assert(k >= 1 && k <= n);
+  const int levels = 64 - __builtin_clzll(n);
+  const int depth = 63 - __builtin_clzll(k);
+  const size_t rank = ((2*(k - (size_t(1) << depth)) + 1) << (levels-1 - depth)) - 1;
+  const size_t last = n - ((size_t(1) << (levels-1)) - 1);  // Keys on the last level, leftmost
+  const size_t before = (rank + 1) / 2;  // Slots of the last level preceding, in the perfect tree
+  return rank - (before > last ? before - last : 0);
+}
+
+// lower_bound over n keys in Eytzinger order, keys[0] at k = 1, as a rank in sorted order. One level
+// per step with no branch, while the 16 keys 4 levels below - contiguous - are prefetched, so that
+// each miss is overlapped with 4 levels of comparisons.
+template<class T, class U, class Less>
+size_t eytzingerLowerBound(const T* keys, size_t n, const U& value, Less less) {
+  size_t k = 1;
+  while (k <= n) {
+    const char* below = reinterpret_cast<const char*>(keys + min(16*k, n) - 1);
+    for (size_t b = 0; b < 16*sizeof(T); b += 64) __builtin_prefetch(below + b);
+    k = 2*k + less(keys[k-1], value);
+  }
+  k >>= __builtin_ffsll(~k);  // Back up to where the search last went left
+  return k ? eytzingerRank(k, n) : n;
+}
@@ -1,330 +1,1660 @@
+#pragma once
+
 #include "algorithms/structures/gsegtree.hpp"
+#include "algorithms/structures/external_sort.hpp"
+#include "algorithms/structures/lower_bound.hpp"
+#include "algorithms/structures/range_tables.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+struct Presorted {};
+
+// Coordinates of a query box: [lo, hi) in every dimension, or [lo, hi] if closed. Trees are queried
+// with boxes through DimCmp::coordinate<IthDim>(v), giving what v has in dimension IthDim to be
+// compared with the bounds by operator< - so no V needs to be made to stand for the bounds.
+template<size_t Dim, class T = double>
+struct Box {
+  array<T, Dim> lo, hi;
+  bool closed = false;
+};
+
+// A side of a Box, where V bounds go: keys precede the lower one if below lo, and the upper one if
+// below hi - or not above it, if the box is closed
+template<size_t Dim, class T>
+struct BoxBound {
+  const array<T, Dim>& at;
+  bool inclusive;
+};
+
+template<size_t Dim, class T>
+BoxBound<Dim, T> lowerBound(const Box<Dim, T>& box) { return {box.lo, false}; }
+
+template<size_t Dim, class T>
+BoxBound<Dim, T> upperBound(const Box<Dim, T>& box) { return {box.hi, box.closed}; }
+
+// A side of a box of keys, cut along dimension Top: the side is that of `rest` in the other
+// dimensions, and `top` in Top - keys precede it there if below top, or not above it, if inclusive.
+// Both sides of a slab between two cuts, or of a slab holding a single coordinate of Top.
+template<class V, size_t Top>
+struct SlabBound {
+  const V& rest;
+  const V& top;
+  bool inclusive;
+};
+
+// Whether a key precedes another key, or a bound, in dimension IthDim
+template<class DimCmp, size_t IthDim>
+struct DimLess {
+  template<class V>
+  bool operator()(const V& v1, const V& v2) const {
+    return DimCmp{}.template precedes<IthDim>(v1, v2);
+  }
+
+  template<class V, size_t Top>
+  bool operator()(const V& v, const SlabBound<V, Top>& b) const {
+    if (IthDim != Top) return DimCmp{}.template precedes<IthDim>(v, b.rest);
+    return b.inclusive ? !DimCmp{}.template precedes<IthDim>(b.top, v) : DimCmp{}.template precedes<IthDim>(v, b.top);
+  }
+
+  template<class V, size_t Dim, class T>
+  bool operator()(const V& v, const BoxBound<Dim, T>& b) const {
+    const auto& c = DimCmp{}.template coordinate<IthDim>(v);
+    return b.inclusive ? !(b.at[IthDim] < c) : c < b.at[IthDim];
+  }
+};
+
+// Whether v is within [a, b) in dimensions From..To-1, for bounds a and b - keys, or BoxBounds
+template<class DimCmp, size_t From, size_t To>
+struct WithinDims {
+  template<class V, class B>
+  static bool check(const V& v, const B& a, const B& b) {
+    return !DimLess<DimCmp, From>{}(v, a) && DimLess<DimCmp, From>{}(v, b)
+        && WithinDims<DimCmp, From+1, To>::check(v, a, b);
+  }
+};
+
+template<class DimCmp, size_t To>
+struct WithinDims<DimCmp, To, To> {
+  template<class V, class B>
+  static bool check(const V& /*v*/, const B& /*a*/, const B& /*b*/) { return true; }
+};
+
+// Mix of trees used only for report(): the last level keeps just its keys, no aggregates
+struct ReportOnly {};
+
+// Mix of trees used only for counting: query gives the number of elements within [a, b), as an int.
+// The last two levels keep nothing but ranks, see ORTStruct<Dim, 1, V, DimCmp, CountOnly, Trans, Bucket, Layout>.
+struct CountOnly {
+  int operator()(int a, int b) const { return a + b; }
+};
+
+// What queries give, V mixed with Mix in general
+template<class V, class Mix>
+struct ORTResult {
+  using type = V;
+  static const V& of(const V& v) { return v; }  // What a single element gives
+};
 
 template<class V>
-using MixT = function<V(V, V)>;
+struct ORTResult<V, CountOnly> {
+  using type = int;
+  static int of(const V& /*v*/) { return 1; }
+};
+
+struct NoValue {};  // Of nodes that are only walked through
+
+// A report() fn deriving from this one takes the keys the last level finds as whole runs, as
+// fn(structure, pa, pb) for keys [pa, pb] of that structure - and the keys of buckets above it one
+// by one, as fn(v), like any other fn
+struct ORTRunReport {};
+
+// Structures of at most Bucket elements keep just their keys, sorted by their own dimension, and
+// are scanned: keys[pa..pb] are those within [a, b) there, and are checked in the Dims below it.
+// This scan checks the keys one by one, for the last level - with no Dims below - and for trees
+// with no buckets, whose DimCmp need not give coordinates.
+template<class DimCmp, class V, size_t Dims>
+struct BucketKeys {
+  BucketKeys() = default;
+  BucketKeys(const ArenaArray<V>& /*keys*/, ArenaRegion& /*region*/) {}
+
+  static size_t footprint(int /*n*/) { return 0; }
+
+  template<class Mix, class B>
+  typename ORTResult<V, Mix>::type scan(const ArenaArray<V>& keys, int pa, int pb,
+                                        const B& a, const B& b, bool& any) const {
+    typename ORTResult<V, Mix>::type v{};
+    for (int p = pa; p <= pb; ++p) {
+      if (!WithinDims<DimCmp, 0, Dims>::check(keys[p], a, b)) continue;
+      v = !any ? any=true, ORTResult<V, Mix>::of(keys[p]) : Mix{}(std::move(v), ORTResult<V, Mix>::of(keys[p]));
+    }
+    return v;
+  }
+
+  template<class B, class Fn>
+  bool report(const ArenaArray<V>& keys, int pa, int pb, const B& a, const B& b, Fn& fn) const {
+    for (int p = pa; p <= pb; ++p)
+      if (WithinDims<DimCmp, 0, Dims>::check(keys[p], a, b) && !fn(keys[p])) return false;
+    return true;
+  }
+};
+
+// A bound in dimension IthDim, as a coordinate: keys precede it if their coordinate is below the
+// one returned - or not above it, if inclusive
+template<class DimCmp, size_t IthDim>
+struct BoundCoordinate {
+  template<class V>
+  static auto of(const V& v, bool& inclusive) {
+    inclusive = false;
+    return DimCmp{}.template coordinate<IthDim>(v);
+  }
 
+  template<size_t Dim, class T>
+  static const T& of(const BoxBound<Dim, T>& b, bool& inclusive) {
+    inclusive = b.inclusive;
+    return b.at[IthDim];
+  }
+
+  template<class V, size_t Top>
+  static auto of(const SlabBound<V, Top>& b, bool& inclusive) {
+    inclusive = IthDim == Top && b.inclusive;
+    return DimCmp{}.template coordinate<IthDim>(IthDim == Top ? b.top : b.rest);
+  }
+};
+
+// in[i] &= whether c[i], of count coordinates, is within the bounds: not below lo - above it, if
+// aInclusive - and below hi - or not above it, if bInclusive. For any T, one key at a time.
+template<class T>
+void clipColumnScalar(const T* c, int count, const T& lo, bool aInclusive, const T& hi, bool bInclusive,
+                      uint8_t* in) {
+  for (int i = 0; i < count; ++i)
+    in[i] &= (aInclusive ? lo < c[i] : !(c[i] < lo)) & (bInclusive ? !(hi < c[i]) : c[i] < hi);
+}
+
+template<class T>
+void clipColumn(const T* c, int count, const T& lo, bool aInclusive, const T& hi, bool bInclusive,
+                uint8_t* in) {
+  clipColumnScalar(c, count, lo, aInclusive, hi, bInclusive, in);
+}
+
+// Of doubles, as clipColumnScalar: four at a time with AVX2, two with SSE2 - compared into a bit
+// mask, spread over in - and the rest one at a time. The comparisons are unordered where the scalar
+// ones are negated, so that NaNs end up the same.
+inline void clipColumn(const double* c, int count, const double& lo, bool aInclusive, const double& hi,
+                       bool bInclusive, uint8_t* in) {
+  int i = 0;
+#if defined(__AVX2__)
+  const __m256d lo4 = _mm256_set1_pd(lo), hi4 = _mm256_set1_pd(hi);
+  for (; i + 4 <= count; i += 4) {
+    const __m256d x = _mm256_loadu_pd(c + i);
+    const __m256d above = aInclusive ? _mm256_cmp_pd(x, lo4, _CMP_GT_OQ) : _mm256_cmp_pd(x, lo4, _CMP_NLT_UQ);
+    const __m256d below = bInclusive ? _mm256_cmp_pd(x, hi4, _CMP_NGT_UQ) : _mm256_cmp_pd(x, hi4, _CMP_LT_OQ);
+    const int bits = _mm256_movemask_pd(_mm256_and_pd(above, below));
+    for (int j = 0; j < 4; ++j)
+      in[i + j] &= bits >> j & 1;
+  }
+#elif defined(__SSE2__)
+  const __m128d lo2 = _mm_set1_pd(lo), hi2 = _mm_set1_pd(hi);
+  for (; i + 2 <= count; i += 2) {
+    const __m128d x = _mm_loadu_pd(c + i);
+    const __m128d above = aInclusive ? _mm_cmpgt_pd(x, lo2) : _mm_cmpnlt_pd(x, lo2);
+    const __m128d below = bInclusive ? _mm_cmpngt_pd(x, hi2) : _mm_cmplt_pd(x, hi2);
+    const int bits = _mm_movemask_pd(_mm_and_pd(above, below));
+    in[i] &= bits & 1;
+    in[i + 1] &= bits >> 1 & 1;
+  }
+#endif
+  clipColumnScalar(c + i, count - i, lo, aInclusive, hi, bInclusive, in + i);
+}
 
-struct Presorted {};  
+// The scan of trees with buckets, over the coordinates of the keys in the Dims below, a column for
+// each, next to the keys. Every column is compared with the bounds as a whole, into a mask, by
+// clipColumn - with SIMD for doubles, where the target has it - and the keys left in the mask are
+// taken. Counting only adds the mask up. Needs DimCmp::coordinate<IthDim>(v), as Box does.
+template<class DimCmp, class V, size_t Dims, size_t Bucket>
+class BucketColumns {
+  using T = decay_t<decltype(DimCmp{}.template coordinate<0>(declval<const V&>()))>;
+  static_assert(is_trivially_copyable<T>::value, "Coordinates are kept in the arena");
 
-template<size_t Dim, size_t IthDim, class V, class GSegTreeV, class GSegTreeTrans>
-class ORTStructTraits {  
  public:
-  int size() const { assert(segTree_); return segTree_->size(); }  
-  
- protected:   
-  
-  ORTStructTraits(const std::vector<GSegTreeV>& initial,
-                  const MixT<V>& mix,
-                  function<GSegTreeV(const GSegTreeV&, const GSegTreeV&)> gMix)
-  : Mix(mix)
-  , segTree_(new GSegTree<GSegTreeV, GSegTreeTrans>(initial, gMix))
+  BucketColumns() = default;
+
+  BucketColumns(const ArenaArray<V>& keys, ArenaRegion& region)
+  : columns_(region.allocate<T>(Dims * keys.size())) {
+    fill(keys, integral_constant<size_t, 0>{});
+  }
+
+  static size_t footprint(int n) { return ArenaRegion::bytes<T>(Dims * n); }
+
+  template<class Mix, class B>
+  typename ORTResult<V, Mix>::type scan(const ArenaArray<V>& keys, int pa, int pb,
+                                        const B& a, const B& b, bool& any) const {
+    uint8_t in[Bucket];
+    mask(keys.size(), pa, pb, a, b, in);
+    return mixIn<Mix>(keys, pa, pb, in, any, is_same<Mix, CountOnly>{});
+  }
+
+  template<class B, class Fn>
+  bool report(const ArenaArray<V>& keys, int pa, int pb, const B& a, const B& b, Fn& fn) const {
+    uint8_t in[Bucket];
+    mask(keys.size(), pa, pb, a, b, in);
+    for (int p = pa; p <= pb; ++p)
+      if (in[p - pa] && !fn(keys[p])) return false;
+    return true;
+  }
+
+ private:
+  template<size_t IthDim>
+  void fill(const ArenaArray<V>& keys, integral_constant<size_t, IthDim>) {
+    T* column = columns_.get() + IthDim * keys.size();
+    for (int p = 0; p < keys.size(); ++p)
+      column[p] = DimCmp{}.template coordinate<IthDim>(keys[p]);
+    fill(keys, integral_constant<size_t, IthDim+1>{});
+  }
+
+  void fill(const ArenaArray<V>& /*keys*/, integral_constant<size_t, Dims>) {}
+
+  // in[p - pa]: whether keys[p] is within [a, b) in all the Dims, for p in [pa, pb]
+  template<class B>
+  void mask(int n, int pa, int pb, const B& a, const B& b, uint8_t* in) const {
+    assert(pb - pa < int(Bucket));
+    fill_n(in, pb - pa + 1, uint8_t(1));
+    clip(n, pa, pb, a, b, in, integral_constant<size_t, 0>{});
+  }
+
+  template<class B, size_t IthDim>
+  void clip(int n, int pa, int pb, const B& a, const B& b, uint8_t* in, integral_constant<size_t, IthDim>) const {
+    bool aInclusive, bInclusive;
+    const auto lo = BoundCoordinate<DimCmp, IthDim>::of(a, aInclusive);
+    const auto hi = BoundCoordinate<DimCmp, IthDim>::of(b, bInclusive);
+    clipColumn(columns_.get() + IthDim * n + pa, pb - pa + 1, T(lo), aInclusive, T(hi), bInclusive, in);
+    clip(n, pa, pb, a, b, in, integral_constant<size_t, IthDim+1>{});
+  }
+
+  template<class B>
+  void clip(int /*n*/, int /*pa*/, int /*pb*/, const B& /*a*/, const B& /*b*/, uint8_t* /*in*/,
+            integral_constant<size_t, Dims>) const {}
+
+  template<class Mix>
+  int mixIn(const ArenaArray<V>& /*keys*/, int pa, int pb, const uint8_t* in, bool& any, true_type) const {
+    int count = 0;
+    for (int p = pa; p <= pb; ++p)
+      count += in[p - pa];
+    any = count > 0;
+    return count;
+  }
+
+  template<class Mix>
+  typename ORTResult<V, Mix>::type mixIn(const ArenaArray<V>& keys, int pa, int pb, const uint8_t* in,
+                                         bool& any, false_type) const {
+    typename ORTResult<V, Mix>::type v{};
+    for (int p = pa; p <= pb; ++p) {
+      if (!in[p - pa]) continue;
+      v = !any ? any=true, ORTResult<V, Mix>::of(keys[p]) : Mix{}(std::move(v), ORTResult<V, Mix>::of(keys[p]));
+    }
+    return v;
+  }
+
+  ArenaPtr<T> columns_;
+};
+
+// How a bucket of level Dims is scanned
+template<class DimCmp, class V, size_t Dims, size_t Bucket>
+using BucketScan = conditional_t<Dims == 0 || Bucket == 0, BucketKeys<DimCmp, V, Dims>, BucketColumns<DimCmp, V, Dims, Bucket>>;
+
+// Stands for the GSegTree of the levels keeping no aggregates: the last of a ReportOnly tree, the
+// last two of a CountOnly one
+struct NoSegTree {
+  template<class Leaf>
+  NoSegTree(int /*s*/, ArenaRegion& /*region*/, const Leaf& /*leaf*/) {}
+
+  NoSegTree() = default;
+
+  static size_t footprint(int /*s*/) { return 0; }
+
+  static GSegTreeLayout layout(int /*s*/) { return {}; }
+
+  bool erased(int /*i*/) const { return false; }
+
+  void assertValid() const {}
+};
+
+// Where the bytes of the structures of one level - one dimension - go, for all of them together
+struct ORTLevelStats {
+  size_t structures = 0;    // With a GSegTree, or a table at the last level
+  size_t buckets = 0;       // Scanned instead, see ORT's Bucket
+  size_t elements = 0;      // Keys of all the structures, so the elements held at this level
+  size_t nodes = 0;         // GSegTree slots, the unused ones included
+  size_t keyBytes = 0;
+  size_t valueBytes = 0;    // Of the nodes: headers of the structures of the level below, aggregates at the last level
+  size_t transBytes = 0;    // Pending updates
+  size_t holeBytes = 0;     // Erased marks
+  size_t cascadeBytes = 0;  // Fractional cascading into the level below
+  size_t paddingBytes = 0;  // Of GSegTree slots past the last element, part of the three above
+
+  size_t bytes() const {
+    return keyBytes + valueBytes + transBytes + holeBytes + cascadeBytes;
+  }
+
+  void add(const GSegTreeLayout& l, size_t count) {
+    nodes += count * l.nodes;
+    valueBytes += count * l.values;
+    transBytes += count * l.trans;
+    holeBytes += count * l.holes;
+    paddingBytes += count * l.padding;
+  }
+};
+
+struct ORTStats {
+  vector<ORTLevelStats> levels;  // By dimension, so the top level is the last one
+  size_t rootBytes = 0;          // The header of the top structure
+  size_t bytes = 0;              // All of the arena: rootBytes and the bytes() of all the levels
+  size_t allocations = 0;        // Heap allocations: the arena alone, none when mapped from a file
+};
+
+// How a structure finds bounds among its keys, sorted by its dimension - ORT's Layout. Index<V> is
+// built over the keys, and searched along with them. This one searches the keys themselves.
+struct SortedKeys {
+  template<class V>
+  class Index {
+   public:
+    Index() = default;
+    Index(const ArenaArray<V>& /*keys*/, ArenaRegion& /*region*/) {}
+
+    static size_t footprint(int /*n*/) { return 0; }
+
+    template<class Less, class B>
+    int lowerBound(const ArenaArray<V>& keys, const B& value) const {
+      return branchlessLowerBound(keys.begin(), keys.end(), value, Less{}) - keys.begin();
+    }
+  };
+};
+
+// Searches a copy of the keys in Eytzinger order instead, n more keys for every structure searched:
+// the levels near the root of the search share cache lines, and the next ones are prefetched.
+// Buckets have no copy, and are searched as sorted.
+struct EytzingerKeys {
+  template<class V>
+  class Index {
+   public:
+    Index() = default;
+    Index(const ArenaArray<V>& keys, ArenaRegion& region)
+    : keys_(region.make<V>(keys.size()), keys.size()) {
+      for (int k = 1; k <= keys.size(); ++k)
+        keys_[k-1] = keys[eytzingerRank(k, keys.size())];
+      region.touched(keys_.begin(), keys_.size() * sizeof(V));
+    }
+
+    static size_t footprint(int n) { return ArenaRegion::bytes<V>(n); }
+
+    template<class Less, class B>
+    int lowerBound(const ArenaArray<V>& keys, const B& value) const {
+      if (keys_.empty()) return SortedKeys::Index<V>().template lowerBound<Less>(keys, value);
+      return eytzingerLowerBound(keys_.begin(), keys_.size(), value, Less{});
+    }
+
+   private:
+    ArenaArray<V> keys_;
+  };
+};
+
+// Index of the structures of level IthDim of Dim. Those of the last level are only searched where
+// it is the top one: below, they are located through the cascade of the level above.
+template<class Layout, class V, size_t Dim, size_t IthDim>
+using ORTIndex = typename conditional_t<IthDim != 0 || Dim == 1, Layout, SortedKeys>::template Index<V>;
+
+// All the ORTStructs of a tree are headers living in a single Arena - the one owned by ORT.
+// They refer to their keys and nodes by ArenaPtrs, own nothing and need no destruction.
+// Keys are allocated by whoever builds the structure, so that they can be shared.
+// Index is that of ORT's Layout where the keys are searched, a base so that SortedKeys takes no bytes.
+template<size_t Dim, size_t IthDim, class V, class GSegTreeV, class GSegTreeMix, class GSegTreeTrans, class Index>
+class ORTStructTraits : protected Index {
+ public:
+  int size() const { return keys_.size(); }
+
+  const ArenaArray<V>& keys() const { return keys_; }  // Sorted by IthDim
+
+ protected:
+  // Upper levels have EmptyMix, so only the last one may be a table; they are never erased from either
+  using SegTree = conditional_t<
+    is_same<GSegTreeMix, ReportOnly>::value || is_same<GSegTreeMix, CountOnly>::value,
+    NoSegTree,
+    conditional_t<
+      IsIdempotent<GSegTreeMix>::value,
+      SparseTable<GSegTreeV, GSegTreeMix>,
+      conditional_t<
+        IsInvertible<GSegTreeMix>::value,
+        PrefixTable<GSegTreeV, GSegTreeMix>,
+        GSegTree<GSegTreeV, GSegTreeMix, GSegTreeTrans, IthDim == 0>
+      >
+    >
+  >;
+
+  // A bucket keeps its keys only, with no SegTree - it is scanned instead
+  template<class Leaf>
+  ORTStructTraits(ArenaArray<V> keys,
+                  bool bucket,
+                  ArenaRegion& region,
+                  const Leaf& leaf)
+  : Index(bucket ? Index() : Index(keys, region))
+  , keys_(keys)
+  , segTree_(bucket ? SegTree() : SegTree(keys.size(), region, leaf))
   {}
-  
-  ORTStructTraits(const ORTStructTraits& other,  
-    const MixT<V>& mix,
-    function<GSegTreeV(const GSegTreeV&, const GSegTreeV&)> gMix)
-  : Mix(mix)
-  , segTree_(other.segTree_ ? new GSegTree<GSegTreeV, GSegTreeTrans>(*other.segTree_, gMix) : nullptr)
+
+  template<class Leaf, class Make>
+  ORTStructTraits(ArenaArray<V> keys,
+                  bool bucket,
+                  ArenaRegion& region,
+                  const Leaf& leaf,
+                  const Make& make,
+                  const ForkJoin& fork)
+  : Index(bucket ? Index() : Index(keys, region))
+  , keys_(keys)
+  , segTree_(bucket ? SegTree() : SegTree(keys.size(), region, leaf, make, fork))
   {}
-  
+
   ORTStructTraits() = default;
-  
-  void swap(ORTStructTraits&& other,
-            function<GSegTreeV(const GSegTreeV&, const GSegTreeV&)> gMix,
-            function<GSegTreeV(const GSegTreeV&, const GSegTreeV&)> gMixOther) {    
-    std::swap(Mix, other.Mix);
-    std::swap(segTree_, other.segTree_);
-    if (segTree_) {
-      assert(gMix);
-      segTree_->resetMix(gMix);
+
+  static size_t footprint(int n) {  // Without the keys
+    return Index::footprint(n) + SegTree::footprint(n);
+  }
+
+  // A search over this level's own keys, branchless
+  template<class Less, class B>
+  pair<int, int> locate(const B& a, const B& b) const {
+    return {Index::template lowerBound<Less>(keys_, a), Index::template lowerBound<Less>(keys_, b)};
+  }
+
+  ArenaArray<V> keys_;
+  SegTree segTree_;
+};
+
+template<size_t Dim, size_t IthDim, class V, class DimCmp, class Mix, class Trans, size_t Bucket, class Layout>
+class ORTStruct;
+
+// A debugger gets onQueryStart(dim, a, b), onPerspectiveSet(dim, first, last) and onLastDimFound(v).
+// This one has none of them: queries call hooks only through debugHook, which drops the call - and
+// whatever its arguments take to compute - at compile time, for this debugger.
+template<class V>
+struct ORTEmptyDebugger {};
+
+template<class Debugger>
+struct IsDebugging : true_type {};
+
+template<class V>
+struct IsDebugging<ORTEmptyDebugger<V>> : false_type {};
+
+template<class Debugger, class Hook>
+void debugHook(Debugger& debugger, const Hook& hook, true_type) {
+  hook(debugger);
+}
+
+template<class Debugger, class Hook>
+void debugHook(Debugger& /*debugger*/, const Hook& /*hook*/, false_type) {}
+
+// hook(debugger), given a generic lambda, so that for ORTEmptyDebugger its body is never instantiated
+template<class Debugger, class Hook>
+void debugHook(Debugger& debugger, const Hook& hook) {
+  debugHook(debugger, hook, IsDebugging<Debugger>{});
+}
+
+struct CascadeRange {  // [a, b) within the keys of a node of the next level
+  int a, b;
+  bool empty() const { return a >= b; }
+};
+
+// Fractional cascading of the next level's keys along the GSegTree of a level (layered range tree).
+// For every position p within the keys of node x, left_ holds the number of keys of x's left child
+// preceding keys[p] - the rest of the preceding keys are in the right child. The keys of the root,
+// the only ones searched, are searched through Index, a base as in ORTStructTraits.
+template<class V, class Less, class Index>
+class ORTCascade : Index {
+ public:
+  ORTCascade() = default;
+
+  // keysOf(x) gives the keys of the structure at node x, for the nodes covering whole intervals.
+  // Only the nodes straddling n have their keys merged here, from the deepest up, into the end of the
+  // root's keys: the keys merged last lie at that end, and are read before overwritten.
+  template<class KeysOf>
+  ORTCascade(int n, int sr, const KeysOf& keysOf, ArenaRegion& region)
+  : left_(region.make<int>(leftSize(n, sr)), leftSize(n, sr))
+  , at_(region.make<int>(sr, -1), sr) {  assert(n > 0); assert(n <= sr);
+    auto keys = [&keysOf](int x) { const auto& k = keysOf(x); return Span{k.begin(), k.end()}; };
+
+    int filled = 0;
+    for (int x = sr; --x>0;)
+      if (last(x, sr) < n)
+        count(x, keys(x), keys(x*2), filled, region);
+
+    if (last(1, sr) < n) {
+      root_ = keysOf(1);
+      assert(filled == left_.size());
+      Index::operator=(Index(root_, region));
+      return;
     }
-    if (other.segTree_) {
-      assert(gMixOther);
-      other.segTree_->resetMix(gMixOther);
+    root_ = ArenaArray<V>(region.make<V>(n), n);
+    V* end = root_.end();
+    Span below = keys(sr+n-1);
+    for (int c = sr+n-1; c > 1; c /= 2) {
+      const int x = c/2;
+      if (last(x, sr) < n) {
+        below = keys(x);
+        continue;
+      }
+      const Span l = c%2 ? keys(x*2) : below;  // A straddling node has no right child, or a whole left one
+      const Span r = c%2 ? below : Span{};
+      const Span merged{mergeInto(l, r, end), end};
+      count(x, merged, l, filled, region);
+      below = merged;
     }
+    assert(below.first == root_.begin());
+    assert(filled == left_.size());
+    Index::operator=(Index(root_, region));
+  }
+
+  // For levels with no structures at their nodes: all the keys are merged here, and only the root's
+  // are kept. The merges of a depth go from the leaves to the root's keys, those of the next one
+  // back, and so on; the leaves are then sorted again. To come out as they went in, they are first
+  // sorted by By, as they are, and then by Less.
+  template<class By>
+  ORTCascade(ArenaArray<V> leaves, int sr, By, ArenaRegion& region)
+  : left_(region.make<int>(leftSize(leaves.size(), sr)), leftSize(leaves.size(), sr))
+  , at_(region.make<int>(sr, -1), sr) {  assert(!leaves.empty()); assert(leaves.size() <= sr);
+    auto leafLess = [](const V& u, const V& v) { return By{}(u, v) || (!By{}(v, u) && Less{}(u, v)); };
+    const int n = leaves.size();
+    sort(leaves.begin(), leaves.end(), leafLess);
+    region.touched(leaves.begin(), n * sizeof(V));
+    root_ = ArenaArray<V>(region.make<V>(n), n);
+
+    int depths = 0;
+    for (int len = 1; len < sr; len *= 2) ++depths;
+    V* from = depths % 2 ? leaves.begin() : root_.begin();  // To end up in root_
+    V* to = depths % 2 ? root_.begin() : leaves.begin();
+    if (from == root_.begin()) {
+      copy(leaves.begin(), leaves.end(), from);
+      region.touched(from, n * sizeof(V));
+    }
+
+    int filled = 0;
+    for (int len = 1; len < sr; len *= 2) {  // Children of len leaves, from the deepest
+      for (int x = sr/len; --x >= sr/len/2;) {
+        const int lo = (x - sr/len/2) * len*2;
+        if (lo >= n) continue;
+        const int mid = min(lo + len, n);
+        const int hi = min(lo + len*2, n);
+        merge(from+lo, from+mid, from+mid, from+hi, to+lo, Less{});
+        count(x, {to+lo, to+hi}, {from+lo, from+mid}, filled, region);
+      }
+      swap(from, to);
+    }
+    assert(from == root_.begin());
+    assert(filled == left_.size());
+
+    copy(root_.begin(), root_.end(), leaves.begin());
+    sort(leaves.begin(), leaves.end(), leafLess);
+    region.touched(leaves.begin(), n * sizeof(V));
+    Index::operator=(Index(root_, region));
+  }
+
+  // Bytes taken from the region by a cascade over n leaves, with node keys given by keysOf
+  static size_t footprint(int n, int sr) {
+    return (n == sr ? 0 : ArenaRegion::bytes<V>(n)) + ranksFootprint(n, sr) + Index::footprint(n);
+  }
+
+  // Bytes taken by a cascade merging its keys by itself
+  static size_t mergingFootprint(int n, int sr) {
+    return ArenaRegion::bytes<V>(n) + ranksFootprint(n, sr) + Index::footprint(n);
+  }
+
+  template<class B>
+  CascadeRange locate(const B& a, const B& b) const {
+    return {Index::template lowerBound<Less>(root_, a), Index::template lowerBound<Less>(root_, b)};
+  }
+
+  CascadeRange down(int x, const CascadeRange& s, int c) const {  assert(at_[x] >= 0);
+    const int* l = &left_[at_[x]];
+    return c == 0 ? CascadeRange{l[s.a], l[s.b]} : CascadeRange{s.a - l[s.a], s.b - l[s.b]};
+  }
+
+ private:
+  using Span = pair<const V*, const V*>;
+
+  // Merges l and r into the keys right before end, which r - or l, if r is empty - may end at;
+  // returns their start. Going forward, what is written never passes what is left of r to read.
+  // On ties those of l go first, as with merge.
+  static V* mergeInto(Span l, Span r, V* end) {
+    if (r.first == r.second && l.second == end) return const_cast<V*>(l.first);
+    V* const first = end - (l.second - l.first) - (r.second - r.first);
+    const V* i = l.first;
+    const V* j = r.first;
+    V* w = first;
+    while (i != l.second)
+      *w++ = j != r.second && Less{}(*j, *i) ? *j++ : *i++;
+    if (w != j) copy(j, r.second, w);
+    return first;
+  }
+
+  // left_ of node x, with keys k, and l of its left child; all three are touched in the region
+  void count(int x, Span k, Span l, int& filled, const ArenaRegion& region) {
+    at_[x] = filled;
+    const V* j = l.first;
+    for (const V* p = k.first; p != k.second; ++p) {
+      while (j != l.second && Less{}(*j, *p)) ++j;
+      left_[filled++] = j - l.first;
+    }
+    left_[filled++] = l.second - l.first;
+    region.touched(k.first, (k.second - k.first) * sizeof(V));
+    region.touched(l.first, (l.second - l.first) * sizeof(V));
+    region.touched(&left_[at_[x]], (filled - at_[x]) * sizeof(int));
+  }
+
+  static size_t ranksFootprint(int n, int sr) {
+    return ArenaRegion::bytes<int>(leftSize(n, sr)) + ArenaRegion::bytes<int>(sr);
+  }
+
+  static int leftSize(int n, int sr) {
+    int size = 0;
+    for (int len = 2; len <= sr; len *= 2)  // Every level holds all the keys, once
+      size += n + (n + len-1) / len;
+    return size;
+  }
+
+  static int last(int x, int sr) {  // Last leaf under node x
+    return (x+1) * (sr >> (__builtin_clz(1) - __builtin_clz(x))) - sr - 1;
   }
-  
-  template<class Locator>
-  pair<int, int> locate(const V& a, const V& b) const {
-    auto range = segTree_->getAll();
-    auto ita = lower_bound(range.first, range.second, a, Locator{});
-    auto itb = lower_bound(range.first, range.second, b, Locator{});
-    int pa = ita - range.first;
-    int pb = itb - range.first;
-    
-    return {pa, pb};
-  }  
- 
-  MixT<V> Mix;
-  unique_ptr<GSegTree<GSegTreeV, GSegTreeTrans>> segTree_;
+
+  ArenaArray<V> root_;
+  ArenaArray<int> left_;
+  ArenaArray<int> at_;
 };
 
-template<size_t Dim, size_t IthDim, class V, class DimCmp, class Trans>
-class ORTStruct;
+struct NoCascade {};
 
+struct NoState {  // For descending without carrying anything along
+  bool empty() const { return false; }
+};
+
+template<class E>
+struct EmptyMix {  // Structures of the next level are made by merging keys, never mixed
+  E operator()(const E& e, const E& /*f*/) const { assert(false); return e; }
+};
 
 template<class E>
-struct EmptyTrans {  
+struct EmptyTrans {
   void apply(E* /*ort*/, int /*dx*/) { assert(false); }
-  E combine(const E& e, int /*len*/) { assert(false); return e; }  
+  E combine(const E& e, int /*len*/) { assert(false); return e; }
   void compose(EmptyTrans* /*t*/) { assert(false); }
   EmptyTrans move(int /*dx*/, int /*dl*/) { assert(false); return {}; }
   static EmptyTrans neutral() { return {}; }
   bool isNeutral() const { return true; }
+  static constexpr bool neutralOnly = true;
 };
 
-template<size_t Dim, size_t IthDim, class V, class DimCmp, class Trans>
+// Scan is a base, so that it takes no bytes in trees with no buckets
+template<size_t Dim, size_t IthDim, class V, class DimCmp, class Mix, class Trans, size_t Bucket, class Layout>
 class ORTStruct : public ORTStructTraits<
     Dim, IthDim, V,
-    ORTStruct<Dim, IthDim-1, V, DimCmp, Trans>,
-    EmptyTrans<ORTStruct<Dim, IthDim-1, V, DimCmp, Trans>>
-> { 
+    ORTStruct<Dim, IthDim-1, V, DimCmp, Mix, Trans, Bucket, Layout>,
+    EmptyMix<ORTStruct<Dim, IthDim-1, V, DimCmp, Mix, Trans, Bucket, Layout>>,
+    EmptyTrans<ORTStruct<Dim, IthDim-1, V, DimCmp, Mix, Trans, Bucket, Layout>>,
+    ORTIndex<Layout, V, Dim, IthDim>
+>, BucketScan<DimCmp, V, IthDim, Bucket> {
   using Base = ORTStructTraits<
     Dim, IthDim, V,
-    ORTStruct<Dim, IthDim-1, V, DimCmp, Trans>,
-     EmptyTrans<ORTStruct<Dim, IthDim-1, V, DimCmp, Trans>>
+    ORTStruct<Dim, IthDim-1, V, DimCmp, Mix, Trans, Bucket, Layout>,
+    EmptyMix<ORTStruct<Dim, IthDim-1, V, DimCmp, Mix, Trans, Bucket, Layout>>,
+    EmptyTrans<ORTStruct<Dim, IthDim-1, V, DimCmp, Mix, Trans, Bucket, Layout>>,
+    ORTIndex<Layout, V, Dim, IthDim>
   >;
-  using NextORT = ORTStruct<Dim, IthDim-1, V, DimCmp, Trans> ;
-  
+  using NextORT = ORTStruct<Dim, IthDim-1, V, DimCmp, Mix, Trans, Bucket, Layout> ;
+  using R = typename ORTResult<V, Mix>::type;
+  using Scan = BucketScan<DimCmp, V, IthDim, Bucket>;
+
+  // Only the last level is cascaded, the one above it locates once at the root
+  static constexpr bool Cascading = IthDim == 1;
+  using Cascade = conditional_t<
+    Cascading,
+    ORTCascade<V, DimLess<DimCmp, IthDim-1>, typename Layout::template Index<V>>,
+    NoCascade
+  >;
+
  public:
-    
-  explicit ORTStruct(const vector<V>& initial, Presorted, const MixT<V>& mix)
-  : Base(
-    intoSingleOrtStructs(initial, mix),
-    mix,
-    bind(&ORTStruct::mixer, this, std::placeholders::_1, std::placeholders::_2)) {  assert(!initial.empty()); assert(mix);
-    }
-    
-  
-  explicit ORTStruct(const vector<V>& initial, const MixT<V>& mix)
-  : ORTStruct(sorted(initial), Presorted{}, mix)
+
+  // Keys, sorted by IthDim, are already in the region. Every level below is built bottom-up,
+  // by merging the keys of the two children; leaves share their only key with this level.
+  explicit ORTStruct(ArenaArray<V> keys, Presorted, ArenaRegion& region, const ForkJoin& fork)
+  : ORTStruct(keys, region.carve(keys.size() <= int(Bucket) ? 0 : nodesFootprint(keys.size())), region, fork)
   {}
-  
-  ORTStruct() = default; // To be default-constructible by GSegTree. GSegTree guarantees that this object won't be used
-  
-  ORTStruct(const ORTStruct& other)
-  : Base(
-      other,
-      other.Mix,
-      bind(&ORTStruct::mixer, this, std::placeholders::_1, std::placeholders::_2))
+
+
+  explicit ORTStruct(ArenaArray<V> keys, ArenaRegion& region, const ForkJoin& fork)
+  : ORTStruct(sorted(keys), Presorted{}, region, fork)
   {}
-  
-  ORTStruct& operator=(ORTStruct&& other) {
-    Base::swap(std::move(other),
-      bind(&ORTStruct::mixer, this, std::placeholders::_1, std::placeholders::_2),
-      bind(&ORTStruct::mixer, &other, std::placeholders::_1, std::placeholders::_2));
-    return *this;
-  }
-  
+
+  ORTStruct() = default; // To be default-constructible by GSegTree. GSegTree guarantees that this object won't be used
+
+  // Bytes taken from the region by a structure over n elements, including all the levels below
+  static size_t footprint(int n) {
+    if (n <= int(Bucket)) return Scan::footprint(n);
+    return Base::footprint(n) + cascadeFootprint(n, integral_constant<bool, Cascading>{}) + nodesFootprint(n);
+  }
+
+  // footprint(n), count times over, split into stats.levels - along the same lines
+  static void account(int n, size_t count, ORTStats& stats) {
+    ORTLevelStats& level = stats.levels[IthDim];
+    level.elements += count * n;
+    if (n <= int(Bucket)) {
+      level.buckets += count;
+      level.keyBytes += count * Scan::footprint(n);
+      return;
+    }
+    level.structures += count;
+    level.add(Base::SegTree::layout(n), count);
+    level.keyBytes += count * Base::Index::footprint(n);
+    level.cascadeBytes += count * cascadeFootprint(n, integral_constant<bool, Cascading>{});
+    for (int len = 1; len <= n; len *= 2) {
+      if (len > 1) stats.levels[IthDim-1].keyBytes += count * (n / len) * ArenaRegion::bytes<V>(len);
+      NextORT::account(len, count * (n / len), stats);
+    }
+  }
+
   void assertValid() const {
      assert(Base::size()>0);
-     assert(Base::Mix);
-     assert(Base::segTree_);
-     assert(Base::size() == Base::segTree_->size());
-     Base::segTree_->assertValid();
-  }
-  
-  struct QueryLocatorComparator {
-    bool operator()(const NextORT& o, const V& v) const {
-      o.assertValid();
-      assert(o.size() == 1);
-      return DimCmp{}.template precedes<IthDim>(o.querySingleton(), v);
-    }
-  };
-  
-  template<class Debugger>
-  V query(const V& a, const V& b, bool& any, Debugger& debugger) const {  assert(Base::segTree_);    
-    any = false;      
-    auto range = Base::template locate<QueryLocatorComparator>(a, b);
-    int pa = range.first;
-    int pb = range.second - 1;  
-  
-    debugger.onQueryStart(IthDim, a, b);
-    if (pa > pb) return V{};
-    
-    V v;
-    Base::segTree_->queryCustom(pa, pb, [&, this](const NextORT& o, int ra, int rb) {
-      debugger.onPerspectiveSet(IthDim, 
-        Base::segTree_->query(ra, ra).querySingleton(), Base::segTree_->query(rb, rb).querySingleton()
-      );
-      bool any_rec = false;
-      V rv = o.query(a, b, any_rec, debugger);
-      if (any_rec) {
-        v = !any ? any=true, rv : Base::Mix(std::move(v), std::move(rv));
-      }
+     assert(Base::size() == Base::keys_.size());
+     if (!bucket()) Base::segTree_.assertValid();
+  }
+
+  template<class B, class Debugger>
+  R query(const B& a, const B& b, bool& any, Debugger& debugger) const {
+    auto range = Base::template locate<DimLess<DimCmp, IthDim>>(a, b);
+    return queryLocated(range.first, range.second - 1, a, b, any, debugger);
+  }
+
+  // Same as query, with [pa, pb] - the leaves of this level within [a, b) - already known
+  template<class B, class Debugger>
+  R queryLocated(int pa, int pb, const B& a, const B& b, bool& any, Debugger& debugger) const {
+    any = false;
+    debugHook(debugger, [&](auto& d) { d.onQueryStart(IthDim, a, b); });
+    if (pa > pb) return R{};
+    if (bucket()) return Scan::template scan<Mix>(Base::keys_, pa, pb, a, b, any);
+
+    return queryBases(pa, pb, a, b, any, debugger, integral_constant<bool, Cascading>{});
+  }
+
+  // fn(v) for every v within [a, b), until fn returns false; then false is returned
+  template<class B, class Fn>
+  bool report(const B& a, const B& b, Fn& fn) const {
+    auto range = Base::template locate<DimLess<DimCmp, IthDim>>(a, b);
+    return reportLocated(range.first, range.second - 1, a, b, fn);
+  }
+
+  template<class B, class Fn>
+  bool reportLocated(int pa, int pb, const B& a, const B& b, Fn& fn) const {
+    if (pa > pb) return true;
+    if (bucket()) return Scan::report(Base::keys_, pa, pb, a, b, fn);
+    return reportBases(pa, pb, a, b, fn, integral_constant<bool, Cascading>{});
+  }
+
+  // Erases one element equal to v from the structures of all the nodes above its leaf
+  bool erase(const V& v) {
+    const int p = find(v);
+    if (p < 0) return false;
+    Base::segTree_.path(p, [&v](NextORT& o) { o.erase(v); });
+    return true;
+  }
+
+  bool contains(const V& v) const {
+    return find(v) >= 0;
+  }
+
+  // Elements equal to v, not erased; each has a leaf of its own
+  int copies(const V& v) const {
+    const auto& keys = Base::keys_;
+    auto range = equal_range(keys.begin(), keys.end(), v, DimLess<DimCmp, IthDim>{});
+    int copies = 0;
+    for (auto it = range.first; it != range.second; ++it)
+      copies += *it == v && (bucket() || leaf(it - keys.begin()).contains(v));
+    return copies;
+  }
+
+  // fn(v) for every element not erased, in order of IthDim
+  template<class Fn>
+  void alive(const Fn& fn) const {
+    for (int p = 0; p < Base::size(); ++p)
+      if (bucket()) fn(Base::keys_[p]);
+      else leaf(p).alive(fn);
+  }
+
+  // t onto every element within [a, b), in the structures of all the nodes holding it. whole: all the
+  // elements here are within [a, b) in the dimensions above; then so are these of nodes within [a, b).
+  void apply(const V& a, const V& b, const Trans& t, bool whole) {
+    auto range = Base::template locate<DimLess<DimCmp, IthDim>>(a, b);
+    if (range.first >= range.second) return;
+    Base::segTree_.overlapping(range.first, range.second - 1, [&](NextORT& o, int ra, int rb) {
+      o.apply(a, b, t, whole && range.first <= ra && rb < range.second);
     });
-    return v;
   }
-  
-  void apply(const V& a, const V& b, const Trans& t) { assert(Base::segTree_);
-    Base::template locateAndQuery<QueryLocatorComparator>(a, b, 
-      [&, this](int pa, int pb) {
-        Base::segTree_->queryCustom(pa, pb, [&, this](const NextORT& o, int ra, int rb) {
-          o.apply(a, b, t);
-        });
-      }
-    );
-  }
-  
-  V querySingleton() const { assert(Base::segTree_ && Base::Mix); assert(Base::size() == 1);
-    return Base::segTree_->query(0, 0).querySingleton();
-  }
-  
-  vector<V> getAll() const { assert(Base::segTree_ && Base::Mix);
-    auto range = Base::segTree_->getAll();
-    vector<V> sum;
-    for (auto it = range.first; it != range.second; ++it) {
-      const NextORT& no = *it;   
-      assert(no.size() == 1);
-      sum.push_back(no.querySingleton());
-    }
-    return sum;    
+
+  vector<V> getAll() const {
+    return {Base::keys_.begin(), Base::keys_.end()};
   }
-  
+
  private:
-  static vector<V> sorted(vector<V> v) {    
-    sort(v.begin(), v.end(), [](const V& v1, const V& v2) { return DimCmp{}.template precedes<IthDim>(v1, v2); });
+  // Every node gets a fixed part of `nodes`, so that nodes can be built in any order, in parallel,
+  // and still be laid out the same way
+  ORTStruct(ArenaArray<V> keys, ArenaRegion nodes, ArenaRegion& region, const ForkJoin& fork)
+  : Base(
+    keys,
+    keys.size() <= int(Bucket),
+    region,
+    [&keys, &nodes, &fork](int i) {
+      ArenaRegion r = nodeRegion(nodes, keys.size(), Base::SegTree::leavesFor(keys.size()) + i);
+      NextORT o(ArenaArray<V>(&keys[i], 1), Presorted{}, r, fork);
+      assert(r.left() == 0);
+      return o;
+    },
+    [&keys, &nodes, &fork](int x, const NextORT& left, const NextORT& right) {
+      ArenaRegion r = nodeRegion(nodes, keys.size(), x);
+      NextORT o = mixer(left, right, r, fork);
+      assert(r.left() == 0);
+      return o;
+    },
+    fork)
+  , Scan(keys.size() <= int(Bucket) ? Scan(keys, region) : Scan())
+  , cascade_(keys.size() <= int(Bucket) ? Cascade() : makeCascade(region, integral_constant<bool, Cascading>{})) {
+    assert(!keys.empty());
+  }
+
+  bool bucket() const {
+    return Base::size() <= int(Bucket);
+  }
+
+  static ArenaArray<V> sorted(ArenaArray<V> keys) {
+    sort(keys.begin(), keys.end(), DimLess<DimCmp, IthDim>{});
+    return keys;
+  }
+
+  const NextORT& leaf(int p) const {
+    return Base::segTree_.node(Base::segTree_.leaves() + p);
+  }
+
+  // Leaf of an element equal to v, not erased yet, or -1. Equal elements have a leaf each.
+  int find(const V& v) const {
+    const auto& keys = Base::keys_;
+    auto range = equal_range(keys.begin(), keys.end(), v, DimLess<DimCmp, IthDim>{});
+    for (auto it = range.first; it != range.second; ++it)
+      if (*it == v && (bucket() || leaf(it - keys.begin()).contains(v))) return it - keys.begin();
+    return -1;
+  }
+
+  // A node of the GSegTree takes its keys and its structure, if its whole interval is valid
+  static size_t nodeFootprint(int len) {
+    return NextORT::footprint(len) + (len > 1 ? ArenaRegion::bytes<V>(len) : 0);
+  }
+
+  static size_t nodesFootprint(int n) {
+    size_t bytes = 0;
+    for (int len = 1; len <= n; len *= 2)
+      bytes += (n / len) * nodeFootprint(len);
+    return bytes;
+  }
+
+  // Nodes are laid out by depth, from the root, and in order within one depth
+  static ArenaRegion nodeRegion(const ArenaRegion& nodes, int n, int x) {
+    const int sr = Base::SegTree::leavesFor(n);
+    const int len = sr >> (__builtin_clz(1) - __builtin_clz(x));
+    size_t offset = size_t(x - sr/len) * nodeFootprint(len);
+    for (int l = len*2; l <= n; l *= 2)
+      offset += (n / l) * nodeFootprint(l);
+    return nodes.sub(offset, nodeFootprint(len));
+  }
+
+  template<class B, class Debugger>
+  R queryBases(int pa, int pb, const B& a, const B& b, bool& any, Debugger& debugger, false_type) const {
+    R v{};
+    Base::segTree_.descend(pa, pb, NoState{},
+      [](int /*x*/, NoState s, int /*c*/) { return s; },
+      [&, this](const NextORT& o, int ra, int rb, NoState) {
+        debugHook(debugger, [&, this](auto& d) {
+          d.onPerspectiveSet(IthDim, Base::keys_[ra], Base::keys_[rb]);
+        });
+        bool any_rec = false;
+        R rv = o.query(a, b, any_rec, debugger);
+        if (any_rec) {
+          v = !any ? any=true, rv : Mix{}(std::move(v), std::move(rv));
+        }
+      });
     return v;
   }
-  
-  static vector<NextORT> intoSingleOrtStructs(const vector<V>& sorted, const MixT<V>& mix) {        
-    vector<NextORT> result;
-    for (const V& v : sorted) {
-      result.push_back(NextORT({v}, mix));
-      result.back().assertValid();
-    }
-    return result;
+
+  // The next level is located once, at the root, and followed down through the cascade
+  template<class B, class Debugger>
+  R queryBases(int pa, int pb, const B& a, const B& b, bool& any, Debugger& debugger, true_type) const {
+    R v{};
+    Base::segTree_.descend(pa, pb, cascade_.locate(a, b),
+      [this](int x, const CascadeRange& s, int c) { return cascade_.down(x, s, c); },
+      [&, this](const NextORT& o, int ra, int rb, const CascadeRange& s) {
+        debugHook(debugger, [&, this](auto& d) {
+          d.onPerspectiveSet(IthDim, Base::keys_[ra], Base::keys_[rb]);
+        });
+        bool any_rec = false;
+        R rv = o.queryLocated(s.a, s.b - 1, a, b, any_rec, debugger);
+        if (any_rec) {
+          v = !any ? any=true, rv : Mix{}(std::move(v), std::move(rv));
+        }
+      });
+    return v;
+  }
+
+  // Once stopped, the remaining bases of this level are passed by, without going any deeper
+  template<class B, class Fn>
+  bool reportBases(int pa, int pb, const B& a, const B& b, Fn& fn, false_type) const {
+    bool going = true;
+    Base::segTree_.descend(pa, pb, NoState{},
+      [](int /*x*/, NoState s, int /*c*/) { return s; },
+      [&](const NextORT& o, int /*ra*/, int /*rb*/, NoState) {
+        going = going && o.report(a, b, fn);
+      });
+    return going;
+  }
+
+  template<class B, class Fn>
+  bool reportBases(int pa, int pb, const B& a, const B& b, Fn& fn, true_type) const {
+    bool going = true;
+    Base::segTree_.descend(pa, pb, cascade_.locate(a, b),
+      [this](int x, const CascadeRange& s, int c) { return cascade_.down(x, s, c); },
+      [&](const NextORT& o, int /*ra*/, int /*rb*/, const CascadeRange& s) {
+        going = going && o.reportLocated(s.a, s.b - 1, a, b, fn);
+      });
+    return going;
   }
-  
-  NextORT mixer(
+
+  Cascade makeCascade(ArenaRegion& region, true_type) const {
+    return Cascade(Base::size(), Base::segTree_.leaves(),
+      [this](int x) -> const ArenaArray<V>& { return Base::segTree_.node(x).keys(); },
+      region);
+  }
+
+  Cascade makeCascade(ArenaRegion& /*region*/, false_type) const {
+    return {};
+  }
+
+  static size_t cascadeFootprint(int n, true_type) {
+    return Cascade::footprint(n, Base::SegTree::leavesFor(n));
+  }
+
+  static size_t cascadeFootprint(int /*n*/, false_type) {
+    return 0;
+  }
+
+  static NextORT mixer(
     const NextORT& left,
-    const NextORT& right) const 
+    const NextORT& right,
+    ArenaRegion& region,
+    const ForkJoin& fork)
   {
-    vector<V> sum;
-    auto l = left.getAll();
-    auto r = right.getAll();
-    merge(l.begin(), l.end(), r.begin(), r.end(), back_inserter(sum),
-      [](const V& v1, const V& v2) { return DimCmp{}.template precedes<IthDim-1>(v1, v2); }
-    );
-    return NextORT{sum, Presorted{}, Base::Mix};
+    const auto& l = left.keys();
+    const auto& r = right.keys();
+    ArenaArray<V> keys(region.make<V>(l.size() + r.size()), l.size() + r.size());
+    merge(l.begin(), l.end(), r.begin(), r.end(), keys.begin(), DimLess<DimCmp, IthDim-1>{});
+    return NextORT(keys, Presorted{}, region, fork);
   }
+
+  Cascade cascade_;
 };
 
-template<size_t Dim, class V, class DimCmp, class Trans>
-class ORTStruct<Dim, 0, V, DimCmp, Trans> : public ORTStructTraits<
-    Dim, 0, V, V, Trans> {  
-  using Base = ORTStructTraits<Dim, 0, V, V, Trans>;
+template<size_t Dim, class V, class DimCmp, class Mix, class Trans, size_t Bucket, class Layout>
+class ORTStruct<Dim, 0, V, DimCmp, Mix, Trans, Bucket, Layout> : public ORTStructTraits<
+    Dim, 0, V, V, Mix, Trans, ORTIndex<Layout, V, Dim, 0>> {
+  using Base = ORTStructTraits<Dim, 0, V, V, Mix, Trans, ORTIndex<Layout, V, Dim, 0>>;
+  using R = typename ORTResult<V, Mix>::type;
+
  public:
-  explicit ORTStruct(const vector<V>& initial, Presorted, const MixT<V>& mix)
-  : Base(initial, mix, mix) {  assert(!initial.empty());  assert(mix);
+  // Linear in size, so always built serially
+  explicit ORTStruct(ArenaArray<V> keys, Presorted, ArenaRegion& region, const ForkJoin& /*fork*/)
+  : Base(keys, keys.size() <= int(Bucket), region, [&keys](int i) { return keys[i]; }) {  assert(!keys.empty());
   }
-  
-  explicit ORTStruct(const vector<V>& initial, const MixT<V>& mix)
-  : ORTStruct(sorted(initial), Presorted{}, mix) {  assert(!initial.empty());  assert(mix);
+
+  explicit ORTStruct(ArenaArray<V> keys, ArenaRegion& region, const ForkJoin& fork)
+  : ORTStruct(sorted(keys), Presorted{}, region, fork) {  assert(!keys.empty());
   }
-  
+
   ORTStruct() = default;  // To be default-constructible by GSegTree. GSegTree guarantees that this object won't be used
-  
-  ORTStruct(const ORTStruct& other)
-  : Base(other, other.Mix, other.Mix)
-  {}
-  
-  ORTStruct& operator=(ORTStruct&& other) {
-    Base::swap(std::move(other), other.Mix, Base::Mix);
-    return *this;
+
+  static size_t footprint(int n) {
+    return n <= int(Bucket) ? 0 : Base::footprint(n);
+  }
+
+  static void account(int n, size_t count, ORTStats& stats) {
+    ORTLevelStats& level = stats.levels[0];
+    level.elements += count * n;
+    if (n <= int(Bucket)) {
+      level.buckets += count;
+      return;
+    }
+    level.structures += count;
+    level.add(Base::SegTree::layout(n), count);
+    level.keyBytes += count * Base::Index::footprint(n);
   }
-  
+
   void assertValid() const {
     assert(Base::size()>0);
-    assert(Base::Mix);
-    assert(Base::segTree_);
-    assert(Base::size() == Base::segTree_->size());
-    Base::segTree_->assertValid();
-  }
-  
-  struct QueryLocatorComparator {
-    bool operator()(const V& v1, const V& v2) const {
-      return DimCmp{}.template precedes<0>(v1, v2);
+    assert(Base::size() == Base::keys_.size());
+    if (!bucket()) Base::segTree_.assertValid();
+  }
+
+  template<class B, class Debugger>
+  R query(const B& a, const B& b, bool& any, Debugger& debugger) const {
+    const auto range = Base::template locate<DimLess<DimCmp, 0>>(a, b);
+    return queryLocated(range.first, range.second - 1, a, b, any, debugger);
+  }
+
+  template<class B, class Debugger>
+  R queryLocated(int pa, int pb, const B& a, const B& b, bool& any, Debugger& debugger) const {
+    any = false;
+    debugHook(debugger, [&](auto& d) { d.onQueryStart(0, a, b); });
+
+    if (pa>pb) return R{};
+    if (bucket()) return BucketKeys<DimCmp, V, 0>().template scan<Mix>(Base::keys_, pa, pb, a, b, any);
+
+    return queryBases(pa, pb, any, debugger, integral_constant<bool, is_same<Mix, CountOnly>::value>{});
+  }
+
+  template<class B, class Fn>
+  bool report(const B& a, const B& b, Fn& fn) const {
+    const auto range = Base::template locate<DimLess<DimCmp, 0>>(a, b);
+    return reportLocated(range.first, range.second - 1, a, b, fn);
+  }
+
+  // All the keys within [pa, pb] are reported - the levels above have checked the other dimensions
+  template<class B, class Fn>
+  bool reportLocated(int pa, int pb, const B& /*a*/, const B& /*b*/, Fn& fn) const {
+    return reportRun(pa, pb, fn, is_base_of<ORTRunReport, Fn>{});
+  }
+
+  // Mix of keys [pa, pb], but the erased ones; any: whether there were others
+  R mixOf(int pa, int pb, bool& any) const {  assert(pa <= pb);
+    any = false;
+    if (!bucket()) {
+      ORTEmptyDebugger<V> debugger;
+      return queryBases(pa, pb, any, debugger, false_type{});
     }
-  };
-  
+    R v = ORTResult<V, Mix>::of(Base::keys_[pa]);
+    for (int p = pa+1; p <= pb; ++p)
+      v = Mix{}(std::move(v), ORTResult<V, Mix>::of(Base::keys_[p]));
+    any = true;
+    return v;
+  }
+
+  // Its key stays in place, as a hole of the GSegTree
+  bool erase(const V& v) {
+    const int p = find(v);
+    if (p < 0) return false;
+    Base::segTree_.erase(p);
+    return true;
+  }
+
+  bool contains(const V& v) const {
+    return find(v) >= 0;
+  }
+
+  int copies(const V& v) const {
+    const auto& keys = Base::keys_;
+    auto range = equal_range(keys.begin(), keys.end(), v, DimLess<DimCmp, 0>{});
+    int copies = 0;
+    for (auto it = range.first; it != range.second; ++it)
+      copies += *it == v && live(it - keys.begin());
+    return copies;
+  }
+
+  template<class Fn>
+  void alive(const Fn& fn) const {
+    for (int p = 0; p < Base::size(); ++p)
+      if (live(p)) fn(Base::keys_[p]);
+  }
+
+  vector<V> getAll() const {
+    if (bucket()) return {Base::keys_.begin(), Base::keys_.end()};
+    auto range = Base::segTree_.getAll();
+    return {range.first, range.second};
+  }
+
+  // Lazily, to one range of the GSegTree if whole; otherwise to every run of keys within [a, b)
+  void apply(const V& a, const V& b, const Trans& t, bool whole) {
+    auto range = Base::template locate<DimLess<DimCmp, 0>>(a, b);
+    if (whole) {
+      if (range.first < range.second) Base::segTree_.apply(range.first, range.second - 1, t);
+      return;
+    }
+    const auto& keys = Base::keys_;
+    for (int p = range.first; p < range.second; ++p) {
+      if (!WithinDims<DimCmp, 1, Dim>::check(keys[p], a, b)) continue;
+      int q = p;
+      while (q+1 < range.second && WithinDims<DimCmp, 1, Dim>::check(keys[q+1], a, b)) ++q;
+      Base::segTree_.apply(p, q, t);
+      p = q;
+    }
+  }
+
+ private:
+  bool bucket() const {
+    return Base::size() <= int(Bucket);
+  }
+
+  bool live(int p) const {  // Not erased
+    return bucket() || !Base::segTree_.erased(p);
+  }
+
+  template<class Fn>
+  bool reportRun(int pa, int pb, Fn& fn, true_type) const {
+    return pa > pb || fn(*this, pa, pb);
+  }
+
+  template<class Fn>
+  bool reportRun(int pa, int pb, Fn& fn, false_type) const {
+    for (int p = pa; p <= pb; ++p)
+      if (live(p) && !fn(Base::keys_[p])) return false;
+    return true;
+  }
+
   template<class Debugger>
-  V query(const V& a, const V& b, bool& any, Debugger& debugger) const { assert(Base::segTree_);    
-    any = false;
-    const auto range = Base::template locate<QueryLocatorComparator>(a, b);
-    int pa = range.first;
-    int pb = range.second - 1;
-    
-    debugger.onQueryStart(0, a, b);
-    
-    if (pa>pb) return V{};
-    
-    V v;
-    Base::segTree_->queryCustom(pa, pb, [&, this](const V& val, int ra, int rb) {
-      debugger.onPerspectiveSet(0, 
-        Base::segTree_->query(ra, ra), Base::segTree_->query(rb, rb)
-      );
-      debugger.onLastDimFound(val);
-      v = !any ? any=true, val : Base::Mix(std::move(v), val);
+  R queryBases(int pa, int pb, bool& any, Debugger& debugger, false_type) const {
+    R v{};
+    Base::segTree_.queryCustom(pa, pb, [&, this](const V& val, int ra, int rb) {
+      debugHook(debugger, [&, this](auto& d) {
+        d.onPerspectiveSet(0, Base::keys_[ra], Base::keys_[rb]);
+        d.onLastDimFound(val);
+      });
+      v = !any ? any=true, val : Mix{}(std::move(v), val);
     });
     return v;
-  }  
-  
-  V querySingleton() const { assert(Base::segTree_ && Base::Mix); assert(Base::size() == 1);
-    return Base::segTree_->query(0, 0);
-  }
-  
-  vector<V> getAll() const { assert(Base::segTree_ && Base::Mix);
-    auto range = Base::segTree_->getAll();
-    return {range.first, range.second};
   }
-  
-  void apply(const V& a, const V& b, const Trans& t) const { assert(Base::segTree_); 
-    return Base::template locateAndQuery<QueryLocatorComparator>(a, b,
-      [this](int pa, int pb) {
-        return Base::segTree_->query(pa, pb);
+
+  template<class Debugger>
+  int queryBases(int pa, int pb, bool& any, Debugger& /*debugger*/, true_type) const {
+    any = true;
+    return pb - pa + 1;
+  }
+
+  static ArenaArray<V> sorted(ArenaArray<V> keys) {
+    sort(keys.begin(), keys.end(), DimLess<DimCmp, 0>{});
+    return keys;
+  }
+
+  int find(const V& v) const {
+    const auto& keys = Base::keys_;
+    auto range = equal_range(keys.begin(), keys.end(), v, DimLess<DimCmp, 0>{});
+    for (auto it = range.first; it != range.second; ++it)
+      if (*it == v && live(it - keys.begin())) return it - keys.begin();
+    return -1;
+  }
+};
+
+// Counting needs no structures at the last level: the number of elements of a base interval is the
+// length of the range the cascade gives for it. So the last two levels are a merge sort tree keeping
+// only ranks - the cascade - and the keys of its root. Nor is there a GSegTree at this level: its
+// nodes are walked by their heap indices alone, over leaves rounded up to a power of two.
+template<size_t Dim, class V, class DimCmp, class Trans, size_t Bucket, class Layout>
+class ORTStruct<Dim, 1, V, DimCmp, CountOnly, Trans, Bucket, Layout> : public ORTStructTraits<
+    Dim, 1, V, NoValue, CountOnly, EmptyTrans<NoValue>, ORTIndex<Layout, V, Dim, 1>>, BucketScan<DimCmp, V, 1, Bucket> {
+  using Base = ORTStructTraits<Dim, 1, V, NoValue, CountOnly, EmptyTrans<NoValue>, ORTIndex<Layout, V, Dim, 1>>;
+  using Cascade = ORTCascade<V, DimLess<DimCmp, 0>, typename Layout::template Index<V>>;
+  using Scan = BucketScan<DimCmp, V, 1, Bucket>;
+
+ public:
+  explicit ORTStruct(ArenaArray<V> keys, Presorted, ArenaRegion& region, const ForkJoin& /*fork*/)
+  : Base(keys, keys.size() <= int(Bucket), region, [](int /*i*/) { return NoValue{}; })
+  , Scan(keys.size() <= int(Bucket) ? Scan(keys, region) : Scan())
+  , cascade_(keys.size() <= int(Bucket) ? Cascade() : Cascade(keys, leavesFor(keys.size()), DimLess<DimCmp, 1>{}, region)) {
+    assert(!keys.empty());
+  }
+
+  explicit ORTStruct(ArenaArray<V> keys, ArenaRegion& region, const ForkJoin& fork)
+  : ORTStruct(sorted(keys), Presorted{}, region, fork)
+  {}
+
+  ORTStruct() = default;
+
+  static size_t footprint(int n) {
+    if (n <= int(Bucket)) return Scan::footprint(n);
+    return Base::footprint(n) + Cascade::mergingFootprint(n, leavesFor(n));
+  }
+
+  // Level 0 keeps nothing but the ranks of the cascade, accounted here
+  static void account(int n, size_t count, ORTStats& stats) {
+    ORTLevelStats& level = stats.levels[1];
+    level.elements += count * n;
+    if (n <= int(Bucket)) {
+      level.buckets += count;
+      level.keyBytes += count * Scan::footprint(n);
+      return;
+    }
+    level.structures += count;
+    level.keyBytes += count * Base::Index::footprint(n);
+    level.cascadeBytes += count * Cascade::mergingFootprint(n, leavesFor(n));
+  }
+
+  void assertValid() const {
+    assert(Base::size()>0);
+  }
+
+  template<class B, class Debugger>
+  int query(const B& a, const B& b, bool& any, Debugger& debugger) const {
+    auto range = Base::template locate<DimLess<DimCmp, 1>>(a, b);
+    return queryLocated(range.first, range.second - 1, a, b, any, debugger);
+  }
+
+  template<class B, class Debugger>
+  int queryLocated(int pa, int pb, const B& a, const B& b, bool& any, Debugger& debugger) const {
+    any = false;
+    debugHook(debugger, [&](auto& d) { d.onQueryStart(1, a, b); });
+    if (pa > pb) return 0;
+    if (bucket()) return Scan::template scan<CountOnly>(Base::keys_, pa, pb, a, b, any);
+
+    const int count = countBases(1, 0, leavesFor(Base::size()), pa, pb, cascade_.locate(a, b));
+    any = count > 0;
+    return count;
+  }
+
+  vector<V> getAll() const {
+    return {Base::keys_.begin(), Base::keys_.end()};
+  }
+
+ private:
+  bool bucket() const {
+    return Base::size() <= int(Bucket);
+  }
+
+  static int leavesFor(int n) {
+    return GSegTree<NoValue, EmptyMix<NoValue>, EmptyTrans<NoValue>>::leavesFor(n);
+  }
+
+  // Keys within [pa, pb] below node x, of leaves [ra, ra + rl): those of the base intervals, as
+  // GSegTree::descend would find them, s being the range of x's keys
+  int countBases(int x, int ra, int rl, int pa, int pb, const CascadeRange& s) const {
+    if (s.empty() || ra + rl-1 < pa || pb < ra) return 0;
+    if (pa <= ra && ra + rl-1 <= pb) return s.b - s.a;
+    return countBases(x*2, ra, rl/2, pa, pb, cascade_.down(x, s, 0))
+         + countBases(x*2+1, ra + rl/2, rl/2, pa, pb, cascade_.down(x, s, 1));
+  }
+
+  static ArenaArray<V> sorted(ArenaArray<V> keys) {
+    sort(keys.begin(), keys.end(), DimLess<DimCmp, 1>{});
+    return keys;
+  }
+
+  Cascade cascade_;
+};
+
+// The k best elements reported to it, by Better, best first. Every run of the last level is a
+// candidate with its best element, its Mix; the best candidate is taken, and the parts of its run on
+// either side of the element go back as two new ones. The element is found by a binary search over
+// mixes of prefixes of the run: O(log n) mixes, each in O(1) with a table at the last level.
+template<class Last, class V, class Mix, class Better>
+class ORTTop : public ORTRunReport {
+  using R = typename ORTResult<V, Mix>::type;
+
+  struct Candidate {
+    R best;
+    const Last* run;  // nullptr for single keys, of buckets
+    int pa, pb;
+  };
+
+ public:
+  bool operator()(const V& v) {
+    candidates_.push_back({ORTResult<V, Mix>::of(v), nullptr, 0, 0});
+    return true;
+  }
+
+  bool operator()(const Last& run, int pa, int pb) {
+    add(run, pa, pb);
+    return true;
+  }
+
+  vector<R> take(int k) {
+    vector<R> top;
+    make_heap(candidates_.begin(), candidates_.end(), Worse{});
+    while (int(top.size()) < k && !candidates_.empty()) {
+      pop_heap(candidates_.begin(), candidates_.end(), Worse{});
+      const Candidate c = std::move(candidates_.back());
+      candidates_.pop_back();
+      if (!c.run) {
+        top.push_back(c.best);
+        continue;
       }
-    );
-  }  
-  
-  void applyAll(const Trans& t) { assert(Base::segTree_ && Base::Mix);
-    return Base::segTree_->apply(0, Base::segTree_->size()-1, t);
+      // The element split at, which is as good as c.best but may not be the one Mix gave, if tied
+      const int p = position(c);
+      bool any;
+      top.push_back(c.run->mixOf(p, p, any));  assert(any);
+      for (auto side : {make_pair(c.pa, p-1), make_pair(p+1, c.pb)}) {
+        if (!add(*c.run, side.first, side.second)) continue;
+        push_heap(candidates_.begin(), candidates_.end(), Worse{});
+      }
+    }
+    return top;
   }
-  
+
  private:
-  static vector<V> sorted(vector<V> s) {
-    sort(s.begin(), s.end(), [](const V& v1, const V& v2) { return DimCmp{}.template precedes<0>(v1, v2); });
-    return s;
+  struct Worse {
+    bool operator()(const Candidate& c1, const Candidate& c2) const {
+      return Better{}(c2.best, c1.best);
+    }
+  };
+
+  bool add(const Last& run, int pa, int pb) {
+    if (pa > pb) return false;
+    bool any;
+    R best = run.mixOf(pa, pb, any);
+    if (any) candidates_.push_back({std::move(best), &run, pa, pb});
+    return any;
   }
+
+  // Of the first key whose prefix of the run is as good as the whole run
+  static int position(const Candidate& c) {
+    int l = c.pa, r = c.pb;
+    while (l < r) {
+      const int m = l + (r-l)/2;
+      bool any;
+      const R prefix = c.run->mixOf(c.pa, m, any);
+      if (any && !Better{}(c.best, prefix)) r = m;
+      else l = m+1;
+    }
+    return l;
+  }
+
+  vector<Candidate> candidates_;
 };
 
-template<class V>
-struct ORTEmptyDebugger {
-  void onQueryStart(size_t /*dim*/, const V& /*v1*/, const V& /*v2*/) {}
-  void onPerspectiveSet(size_t /*dim*/, const V& /*v1*/, const V& /*v2*/) {}
-  void onLastDimFound(const V&) {}
+// What a file of an ORT starts with, followed by the arena, as it is in memory
+struct ORTFileHeader {
+  static constexpr uint32_t Version = 3;
+
+  char magic[8];
+  uint32_t version, dim;
+  uint64_t keyBytes, rootBytes, elements, bytes, checksum;
+
+  static ORTFileHeader magicOnly() {
+    ORTFileHeader h{};
+    memcpy(h.magic, "ORTREE\0\0", sizeof(h.magic));
+    h.version = Version;
+    return h;
+  }
 };
 
-template<size_t Dim, class V, class DimCmp, class Trans>
+// The whole tree is laid out in one buffer of a size known before building it, with its root first.
+// Moving an ORT moves the buffer; copying it copies the buffer byte-wise.
+// Built on up to `threads` threads; the layout, and so the result, does not depend on their number.
+// Mix, like DimCmp, is a stateless functor - V Mix::operator()(V, V) - so it is inlined wherever used.
+// Structures of at most Bucket elements, at any level, keep just their keys - and their coordinates
+// in the dimensions below, by DimCmp::coordinate<IthDim>(v) - and are scanned; that drops the
+// bottom log(Bucket) levels of every tree below the top one. Such trees are static: buckets keep no
+// aggregates, so erase and apply do not compile with Bucket > 0.
+// A Mix declared idempotent or invertible (see range_tables.hpp) is answered in O(1) at the last
+// level, by a table instead of a GSegTree - a log factor less per query. Such trees are static too;
+// Updatable<Mix> keeps the GSegTree.
+// Layout is how keys are searched where queries locate them: SortedKeys, or EytzingerKeys for fewer
+// cache misses per search at the cost of a copy of the keys searched.
+template<size_t Dim, class V, class DimCmp, class Mix, class Trans, size_t Bucket = 0, class Layout = SortedKeys>
 class ORT {
- public:  
-  explicit ORT(const vector<V>& initial, const function<V(V, V)>& mix)
-  : struct_(initial, mix) {}
-  
+  using Root = ORTStruct<Dim, Dim-1, V, DimCmp, Mix, Trans, Bucket, Layout>;
+  using R = typename ORTResult<V, Mix>::type;
+
+ public:
+  explicit ORT(vector<V> initial, unsigned threads = 1)
+  : arena_(footprint(initial.size())) {  assert(!initial.empty());
+    ArenaRegion region = arena_.region();
+    Root* root = region.allocate<Root>(1);
+    auto keys = region.copy(make_move_iterator(initial.begin()), make_move_iterator(initial.end()));
+    new (root) Root(keys, region, ForkJoin(threads));
+    assert(region.left() == 0);
+  }
+
+  // Bytes a tree over n elements takes, all in a single allocation
+  static size_t footprint(int n) {
+    return ArenaRegion::bytes<Root>(1) + ArenaRegion::bytes<V>(n) + Root::footprint(n);
+  }
+
+  size_t bytes() const {
+    return arena_.size();
+  }
+
+  // Where footprint(n) goes, before building. The layout depends on n alone, so this is exact.
+  static ORTStats stats(int n) {  assert(n > 0);
+    ORTStats stats;
+    stats.levels.resize(Dim);
+    stats.rootBytes = ArenaRegion::bytes<Root>(1);
+    stats.levels[Dim-1].keyBytes += ArenaRegion::bytes<V>(n);
+    Root::account(n, 1, stats);
+    stats.bytes = footprint(n);
+    stats.allocations = 1;
+    assert(stats.bytes == accumulate(stats.levels.begin(), stats.levels.end(), stats.rootBytes,
+                                     [](size_t b, const ORTLevelStats& l) { return b + l.bytes(); }));
+    return stats;
+  }
+
+  ORTStats stats() const {
+    ORTStats s = stats(root().size());  assert(s.bytes == bytes());
+    s.allocations = arena_.mapped() ? 0 : 1;
+    return s;
+  }
+
   template<class Debugger>
-  V query(const V& a, const V& b, bool& any, Debugger& debugger) const {
-    return struct_.query(a, b, any, debugger);
+  R query(const V& a, const V& b, bool& any, Debugger& debugger) const {
+    static_assert(!is_same<Mix, ReportOnly>::value, "ReportOnly trees can only report");
+    return root().query(a, b, any, debugger);
   }
-  
-  V query(const V& a, const V& b, bool& any) const {
+
+  R query(const V& a, const V& b, bool& any) const {
     ORTEmptyDebugger<V> debugger;
     return query(a, b, any, debugger);
   }
-  
+
+  // The number of elements within [a, b), for Mix = CountOnly
+  template<class M = Mix, class = enable_if_t<is_same<M, CountOnly>::value>>
+  int query(const V& a, const V& b) const {
+    bool any;
+    return query(a, b, any);
+  }
+
+  // Passes every element within [a, b) to fn, in no particular order, in O(log^Dim n + k) for k of
+  // them. Only keys are read, so Mix may be ReportOnly. fn(const V&) returns false to stop; report
+  // then returns false as well.
+  template<class Fn>
+  bool report(const V& a, const V& b, Fn fn) const {
+    return root().report(a, b, fn);
+  }
+
+  // As the ones above, within a Box - for DimCmp with coordinate<IthDim>(const V&)
+  template<class T>
+  R query(const Box<Dim, T>& box, bool& any) const {
+    static_assert(!is_same<Mix, ReportOnly>::value, "ReportOnly trees can only report");
+    ORTEmptyDebugger<V> debugger;
+    return root().query(lowerBound(box), upperBound(box), any, debugger);
+  }
+
+  template<class T, class M = Mix, class = enable_if_t<is_same<M, CountOnly>::value>>
+  int query(const Box<Dim, T>& box) const {
+    bool any;
+    return query(box, any);
+  }
+
+  template<class T, class Fn>
+  bool report(const Box<Dim, T>& box, Fn fn) const {
+    return root().report(lowerBound(box), upperBound(box), fn);
+  }
+
+  // As the ones above, within a slab of [a, b) - between SlabBounds, made of V
+  template<size_t Top, class Debugger>
+  R query(const SlabBound<V, Top>& a, const SlabBound<V, Top>& b, bool& any, Debugger& debugger) const {
+    static_assert(!is_same<Mix, ReportOnly>::value, "ReportOnly trees can only report");
+    return root().query(a, b, any, debugger);
+  }
+
+  template<size_t Top, class Fn>
+  bool report(const SlabBound<V, Top>& a, const SlabBound<V, Top>& b, Fn fn) const {
+    return root().report(a, b, fn);
+  }
+
+  // The k best elements within [a, b), best first, by Better - a stateless functor, Better{}(v1, v2)
+  // being whether v1 is better than v2. Mix must pick the better one of its two arguments, like a
+  // max. In O(log^Dim n + k (log n + log k)), however many elements there are within [a, b), with a
+  // table at the last level - so for an idempotent Mix; a GSegTree takes O(log^2 n) per element.
+  template<class Better>
+  vector<R> top(const V& a, const V& b, int k) const {
+    static_assert(!is_same<Mix, ReportOnly>::value && !is_same<Mix, CountOnly>::value,
+                  "Only trees with aggregates can pick the best elements");
+    ORTTop<ORTStruct<Dim, 0, V, DimCmp, Mix, Trans, Bucket, Layout>, V, Mix, Better> top;
+    if (k > 0) root().report(a, b, top);
+    return top.take(k);
+  }
+
+  template<class Better, class T>
+  vector<R> top(const Box<Dim, T>& box, int k) const {
+    static_assert(!is_same<Mix, ReportOnly>::value && !is_same<Mix, CountOnly>::value,
+                  "Only trees with aggregates can pick the best elements");
+    ORTTop<ORTStruct<Dim, 0, V, DimCmp, Mix, Trans, Bucket, Layout>, V, Mix, Better> top;
+    if (k > 0) root().report(lowerBound(box), upperBound(box), top);
+    return top.take(k);
+  }
+
   vector<V> getAll() const {
-    return struct_.getAll();
+    return root().getAll();
+  }
+
+  // Erases one element equal to v (by V::operator==), if there is any left; false if there is not.
+  // Erased elements keep their place in the arena, as holes skipped by queries, so the tree does not
+  // shrink. O(log^Dim n). Not for ReportOnly or CountOnly trees - they keep no aggregates to update.
+  bool erase(const V& v) {
+    static_assert(!is_same<Mix, ReportOnly>::value && !is_same<Mix, CountOnly>::value,
+                  "Only trees with aggregates can erase");
+    static_assert(Bucket == 0, "Buckets keep no aggregates to update");
+    static_assert(!IsIdempotent<Mix>::value && !IsInvertible<Mix>::value,
+                  "The last level is a static table; use Updatable<Mix> to erase");
+    return root().erase(v);
+  }
+
+  bool contains(const V& v) const {
+    return root().contains(v);
+  }
+
+  // Elements equal to v, not erased
+  int copies(const V& v) const {
+    return root().copies(v);
+  }
+
+  // fn(v) for every element not erased
+  template<class Fn>
+  void alive(const Fn& fn) const {
+    root().alive(fn);
+  }
+
+  // A header, then the arena byte by byte: the file is the tree, so it can be mapped and queried with
+  // no deserialization. Needs V and Trans trivially copyable, so that the arena holds no pointers
+  // but relative ones. The file is bound to the build - types, sizes and endianness.
+  void save(const string& path) const {
+    static_assert(is_trivially_copyable<V>::value && is_trivially_copyable<Trans>::value,
+                  "Only trees of trivially copyable types can be saved");
+    ORTFileHeader h = header(root().size());
+    h.checksum = arena_.checksum();
+    ofstream out(path, ios::binary | ios::trunc);
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(string(headerBytes() - sizeof(h), '\0').data(), headerBytes() - sizeof(h));
+    arena_.write(out);
+    if (!out.flush()) throw runtime_error("Cannot write " + path);
+  }
+
+  // Maps a file made by save; pages are read as queries touch them, and shared by all the processes
+  // mapping the same file, so it may be larger than memory. verify reads the whole file once, to
+  // check the checksum.
+  static ORT load(const string& path, bool verify = true) {
+    static_assert(is_trivially_copyable<V>::value && is_trivially_copyable<Trans>::value,
+                  "Only trees of trivially copyable types can be loaded");
+    ORTFileHeader h;
+    ifstream in(path, ios::binary);
+    if (!in.read(reinterpret_cast<char*>(&h), sizeof(h))) throw runtime_error("Cannot read " + path);
+    const ORTFileHeader expected = header(h.elements);
+    if (memcmp(h.magic, expected.magic, sizeof(h.magic)) || h.version != expected.version)
+      throw runtime_error("Not an ORT file of this version: " + path);
+    if (h.elements == 0 || h.dim != expected.dim || h.keyBytes != expected.keyBytes || h.rootBytes != expected.rootBytes
+        || h.bytes != expected.bytes)
+      throw runtime_error("ORT of another type: " + path);
+
+    ORT tree(Arena::map(path, headerBytes(), h.bytes));
+    if (verify && tree.arena_.checksum() != h.checksum) throw runtime_error("Corrupt " + path);
+    return tree;
   }
-  
+
+  // Builds the tree of the elements in the file at input - as elementsIn reads them - straight into
+  // a file at path, the one save would make, and maps it as load does. For more elements than fit in
+  // memory: the arena is a mapping of the file being built, and the two halves of `memory` go to
+  // sorting them externally and to keeping the arena resident within, by dropping its pages as they
+  // are written - the system writes them back. Merges of keys not kept go through the arena too,
+  // never the heap.
+  static ORT build(const string& input, const string& path, size_t memory, unsigned threads = 1) {
+    static_assert(is_trivially_copyable<V>::value && is_trivially_copyable<Trans>::value,
+                  "Only trees of trivially copyable types can be built into a file");
+    const size_t n = elementsIn<V>(input);
+    if (n == 0) throw runtime_error("No elements in " + input);
+    if (n > size_t(numeric_limits<int>::max())) throw length_error("Too many elements");
+    {
+      Arena arena = Arena::create(path, headerBytes(), footprint(n));
+      ArenaResidentLimit limit(arena, memory / 2);
+      ArenaRegion region = arena.region();
+      Root* root = region.allocate<Root>(1);
+      V* keys = region.allocate<V>(n);
+      V* at = keys;
+      externalSort<V, DimLess<DimCmp, Dim-1>>(input, path, memory - memory / 2, [&](const V& v) {
+        region.touched(new (at++) V(v), sizeof(V));
+      });
+      assert(at == keys + n);
+      new (root) Root(ArenaArray<V>(keys, n), Presorted{}, region, ForkJoin(threads));
+      assert(region.left() == 0);
+      assert(!arena.tracking());
+
+      ORTFileHeader h = header(n);
+      h.checksum = arena.checksum();
+      arena.sync();
+      fstream out(path, ios::binary | ios::in | ios::out);
+      out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+      if (!out.flush()) throw runtime_error("Cannot write " + path);
+    }
+    return load(path, false);
+  }
+
+  // Updates the value of every element within [a, b) by t, as queries see it. Keys stay as they were
+  // built - DimCmp must not depend on what t changes - so report, alive and erase see elements as
+  // they were inserted. An element is held by a structure at every level, and all of them are
+  // updated: the ones whose elements within [a, b) make a single range, lazily in O(log n), the
+  // others run by run. t.move() offsets count from the start of each range.
+  void apply(const V& a, const V& b, const Trans& t) {
+    static_assert(!is_same<Mix, ReportOnly>::value && !is_same<Mix, CountOnly>::value,
+                  "Only trees with aggregates can apply");
+    static_assert(Bucket == 0, "Buckets keep no aggregates to update");
+    static_assert(!IsIdempotent<Mix>::value && !IsInvertible<Mix>::value,
+                  "The last level is a static table; use Updatable<Mix> to apply");
+    root().apply(a, b, t, true);
+  }
+
  private:
-  ORTStruct<Dim, Dim-1, V, DimCmp, Trans> struct_;
+  explicit ORT(Arena arena) : arena_(std::move(arena)) {}
+
+  const Root& root() const { return *arena_.at<Root>(0); }
+  Root& root() { return *arena_.at<Root>(0); }
+
+  static ORTFileHeader header(uint64_t elements) {
+    ORTFileHeader h = ORTFileHeader::magicOnly();
+    h.dim = Dim;
+    h.keyBytes = sizeof(V);
+    h.rootBytes = sizeof(Root);
+    h.elements = elements;
+    h.bytes = elements > 0 && elements <= uint64_t(numeric_limits<int>::max()) ? footprint(elements) : 0;
+    return h;
+  }
+
+  static size_t headerBytes() {
+    return ArenaRegion::bytes<ORTFileHeader>(1);
+  }
+
+  Arena arena_;
 };
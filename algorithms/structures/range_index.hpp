@@ -0,0 +1,68 @@
+#pragma once
+
+#include "algorithms/structures/kd_tree.hpp"
+#include "algorithms/structures/ort.hpp"
+
+// ORT if it fits in the memory budget, KDTree otherwise - chosen at build time, behind the same
+// queries. ORT knows its size before building, so the choice costs nothing. Callers trade query
+// time for memory by the budget alone.
+template<size_t Dim, class V, class DimCmp, class Mix, class Trans>
+class RangeIndex {
+  using Tree = ORT<Dim, V, DimCmp, Mix, Trans>;
+  using Linear = KDTree<Dim, V, DimCmp, Mix>;
+  using R = typename ORTResult<V, Mix>::type;
+
+ public:
+  enum class Engine { ORT, KDTree };
+
+  // ORT when its footprint is within budget bytes
+  static Engine choose(size_t n, size_t budget) {
+    return n <= size_t(numeric_limits<int>::max()) && Tree::footprint(n) <= budget ? Engine::ORT : Engine::KDTree;
+  }
+
+  RangeIndex(vector<V> initial, size_t budget, unsigned threads = 1) {  assert(!initial.empty());
+    if (choose(initial.size(), budget) == Engine::ORT) tree_.reset(new Tree(std::move(initial), threads));
+    else linear_.reset(new Linear(std::move(initial), threads));
+  }
+
+  Engine engine() const {
+    return tree_ ? Engine::ORT : Engine::KDTree;
+  }
+
+  R query(const V& a, const V& b, bool& any) const {
+    return tree_ ? tree_->query(a, b, any) : linear_->query(a, b, any);
+  }
+
+  template<class M = Mix, class = enable_if_t<is_same<M, CountOnly>::value>>
+  int query(const V& a, const V& b) const {
+    return tree_ ? tree_->query(a, b) : linear_->query(a, b);
+  }
+
+  template<class Fn>
+  bool report(const V& a, const V& b, Fn fn) const {
+    return tree_ ? tree_->report(a, b, std::ref(fn)) : linear_->report(a, b, std::ref(fn));
+  }
+
+  template<class T>
+  R query(const Box<Dim, T>& box, bool& any) const {
+    return tree_ ? tree_->query(box, any) : linear_->query(box, any);
+  }
+
+  template<class T, class M = Mix, class = enable_if_t<is_same<M, CountOnly>::value>>
+  int query(const Box<Dim, T>& box) const {
+    return tree_ ? tree_->query(box) : linear_->query(box);
+  }
+
+  template<class T, class Fn>
+  bool report(const Box<Dim, T>& box, Fn fn) const {
+    return tree_ ? tree_->report(box, std::ref(fn)) : linear_->report(box, std::ref(fn));
+  }
+
+  size_t bytes() const {
+    return tree_ ? tree_->bytes() : linear_->bytes();
+  }
+
+ private:
+  unique_ptr<const Tree> tree_;  // One of the two
+  unique_ptr<const Linear> linear_;
+};
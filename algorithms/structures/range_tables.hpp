@@ -0,0 +1,201 @@
+#pragma once
+
+#include <includes/header.hpp>
+#include "algorithms/structures/arena.hpp"
+#include "algorithms/structures/gsegtree.hpp"
+
+// What a Mix may declare about itself, to be queried in O(1) at the last level:
+// static constexpr bool idempotent = true;  - Mix(v, v) == v, like max
+// static constexpr bool invertible = true;  - with V unmix(V whole, V prefix), such that
+//                                             Mix(prefix, unmix(whole, prefix)) == whole, like sum
+template<class Mix, class = void>
+struct IsIdempotent : false_type {};
+
+template<class Mix>
+struct IsIdempotent<Mix, enable_if_t<Mix::idempotent>> : true_type {};
+
+template<class Mix, class = void>
+struct IsInvertible : false_type {};
+
+template<class Mix>
+struct IsInvertible<Mix, enable_if_t<Mix::invertible>> : true_type {};
+
+// Mix with whatever it declares hidden, so that the last level stays a GSegTree, which can be
+// updated - by erase and apply
+template<class Mix>
+struct Updatable : Mix {
+  static constexpr bool idempotent = false;
+  static constexpr bool invertible = false;
+};
+
+// Ranges of an idempotent Mix in O(1): a sparse table over blocks of Block leaves, and the mixes of
+// every leaf with the start and with the end of its block. Ranges within a single block are mixed
+// leaf by leaf. Takes about 3 values per leaf. Static: nothing can be updated once built.
+template<class V, class Mix>
+class SparseTable {
+ public:
+  static constexpr int Block = 16;
+
+  template<class Leaf>
+  SparseTable(int s, ArenaRegion& region, const Leaf& leaf)
+  : S(s), NB(blocksFor(s)), K(levelsFor(NB)) {  assert(s > 0);
+    D = region.make<V>(S);
+    P = region.make<V>(S);
+    Q = region.make<V>(S);
+    T = region.make<V>(NB*K);
+    // Whole blocks at a time, each touched in the region once filled
+    const int chunk = max<int>(1, ArenaRegion::TouchChunk / sizeof(V) / Block) * Block;
+    for (int c = 0; c < S; c += chunk) {
+      const int e = min(S, c + chunk);
+      for (int i = c; i < e; ++i) {
+        D[i] = leaf(i);
+        P[i] = i % Block ? mix(P[i-1], D[i]) : D[i];
+      }
+      for (int i = e; i-- > c;)
+        Q[i] = (i+1) % Block && i+1 < S ? mix(D[i], Q[i+1]) : D[i];
+      for (int b = c / Block; b < blocksFor(e); ++b)
+        T[b] = Q[b*Block];
+      region.touched(D.get() + c, (e - c) * sizeof(V));
+      region.touched(P.get() + c, (e - c) * sizeof(V));
+      region.touched(Q.get() + c, (e - c) * sizeof(V));
+    }
+    for (int k = 1; k < K; ++k) {
+      for (int b = 0; b + (1<<k) <= NB; ++b)
+        T[k*NB + b] = mix(T[(k-1)*NB + b], T[(k-1)*NB + b + (1<<(k-1))]);
+      region.touched(T.get() + (k-1)*NB, 2 * NB * sizeof(V));
+    }
+  }
+
+  SparseTable() = default;
+
+  static size_t footprint(int s) {
+    const int nb = blocksFor(s);
+    return 3*ArenaRegion::bytes<V>(s) + ArenaRegion::bytes<V>(nb*levelsFor(nb));
+  }
+
+  // Leaves count as nodes; the ends of the levels of the sparse table are never filled
+  static GSegTreeLayout layout(int s) {
+    const int nb = blocksFor(s), k = levelsFor(nb);
+    GSegTreeLayout l;
+    l.nodes = s;
+    l.values = footprint(s);
+    l.padding = ((size_t(1) << k) - 1 - k) * sizeof(V);
+    return l;
+  }
+
+  int size() const { return S; }
+
+  void assertValid() const { assert(size()>0); assert(D); }
+
+  V query(int a, int b) const {  assert(a>=0); assert(a<=b); assert(b<S);
+    const int ba = a / Block, bb = b / Block;
+    if (a % Block == 0 && ba < bb) return mix(bb - ba > 1 ? blocks(ba, bb-1) : T[ba], P[b]);
+    if (a % Block == 0) return P[b];
+    if ((b+1) % Block == 0 || b+1 == S) {
+      if (ba == bb) return Q[a];
+      return bb - ba > 1 ? mix(Q[a], blocks(ba+1, bb)) : mix(Q[a], T[bb]);
+    }
+    if (ba == bb) {
+      V v = D[a];
+      for (int i = a+1; i <= b; ++i)
+        v = mix(v, D[i]);
+      return v;
+    }
+    return mix(bb - ba > 1 ? mix(Q[a], blocks(ba+1, bb-1)) : Q[a], P[b]);
+  }
+
+  // As GSegTree::queryCustom, with [a, b] as the only base interval
+  template<class Fn>
+  void queryCustom(int a, int b, const Fn& fn) const {
+    fn(query(a, b), a, b);
+  }
+
+  bool erased(int /*i*/) const { return false; }
+
+  pair<const V*, const V*> getAll() const {
+    return {D.get(), D.get() + S};
+  }
+
+ private:
+  static V mix(const V& l, const V& r) {
+    return Mix{}(l, r);
+  }
+
+  V blocks(int l, int r) const {  // Of whole blocks [l, r], possibly overlapping
+    const int k = __builtin_clz(1) - __builtin_clz(r - l + 1);
+    return mix(T[k*NB + l], T[k*NB + r - (1<<k) + 1]);
+  }
+
+  static int blocksFor(int s) {
+    return (s + Block-1) / Block;
+  }
+
+  static int levelsFor(int nb) {
+    return __builtin_clz(1) - __builtin_clz(nb) + 1;
+  }
+
+  int S = 0, NB = 0, K = 0;
+  ArenaPtr<V> D;  // Leaves
+  ArenaPtr<V> P;  // From the start of the block
+  ArenaPtr<V> Q;  // To the end of the block
+  ArenaPtr<V> T;  // Of 2^k blocks from b, at k*NB + b
+};
+
+// Ranges of an invertible Mix in O(1), out of two prefixes. Static, as SparseTable.
+template<class V, class Mix>
+class PrefixTable {
+ public:
+  template<class Leaf>
+  PrefixTable(int s, ArenaRegion& region, const Leaf& leaf)
+  : S(s) {  assert(s > 0);
+    D = region.make<V>(S);
+    P = region.make<V>(S);
+    const int chunk = max<int>(1, ArenaRegion::TouchChunk / sizeof(V));
+    for (int c = 0; c < S; c += chunk) {  // Each touched in the region once filled
+      const int e = min(S, c + chunk);
+      for (int i = c; i < e; ++i) {
+        D[i] = leaf(i);
+        P[i] = i ? Mix{}(P[i-1], D[i]) : D[i];
+      }
+      region.touched(D.get() + c, (e - c) * sizeof(V));
+      region.touched(P.get() + c, (e - c) * sizeof(V));
+    }
+  }
+
+  PrefixTable() = default;
+
+  static size_t footprint(int s) {
+    return 2*ArenaRegion::bytes<V>(s);
+  }
+
+  static GSegTreeLayout layout(int s) {
+    GSegTreeLayout l;
+    l.nodes = s;
+    l.values = footprint(s);
+    return l;
+  }
+
+  int size() const { return S; }
+
+  void assertValid() const { assert(size()>0); assert(D); }
+
+  V query(int a, int b) const {  assert(a>=0); assert(a<=b); assert(b<S);
+    return a ? Mix{}.unmix(P[b], P[a-1]) : P[b];
+  }
+
+  template<class Fn>
+  void queryCustom(int a, int b, const Fn& fn) const {
+    fn(query(a, b), a, b);
+  }
+
+  bool erased(int /*i*/) const { return false; }
+
+  pair<const V*, const V*> getAll() const {
+    return {D.get(), D.get() + S};
+  }
+
+ private:
+  int S = 0;
+  ArenaPtr<V> D;  // Leaves
+  ArenaPtr<V> P;  // Of leaves [0, i]
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "algorithms/structures/ort.hpp"
+
+template<size_t Dim, class Rank>
+using RankPoint = array<Rank, Dim>;
+
+template<size_t Dim>
+struct RankCmp {
+  template<size_t IthDim, class Rank>
+  static bool precedes(const RankPoint<Dim, Rank>& p1, const RankPoint<Dim, Rank>& p2) {
+    return p1[IthDim] < p2[IthDim];
+  }
+};
+
+// ORT over ranks instead of coordinates: every element is replaced by its positions in the orders
+// of all the dimensions, as Rank - uint32_t, or uint16_t for fewer than 65536 elements. Every level
+// then keeps and compares these, and the original elements are kept once, in order of dimension 0,
+// so the rank there tells which one it is. Query bounds are turned into ranks up front, by a binary
+// search per dimension - of Vs, or of the coordinates of a Box. For Mix = ReportOnly or CountOnly -
+// aggregates need the original values.
+template<size_t Dim, class V, class DimCmp, class Mix, class Rank = uint32_t>
+class RankSpaceORT {
+  static_assert(is_same<Mix, ReportOnly>::value || is_same<Mix, CountOnly>::value,
+                "Ranks can only be reported or counted");
+  using Point = RankPoint<Dim, Rank>;
+  using Tree = ORT<Dim, Point, RankCmp<Dim>, Mix, EmptyTrans<Point>>;
+
+ public:
+  explicit RankSpaceORT(vector<V> initial, unsigned threads = 1)
+  : elements_(std::move(initial))
+  , tree_(ranked(threads)) {
+  }
+
+  // The number of elements within [a, b)
+  template<class M = Mix, class = enable_if_t<is_same<M, CountOnly>::value>>
+  int query(const V& a, const V& b) const {
+    Point ra, rb;
+    return bounds(a, b, ra, rb) ? tree_.query(ra, rb) : 0;
+  }
+
+  // fn(const V&) for every element within [a, b), as ORT::report
+  template<class Fn>
+  bool report(const V& a, const V& b, Fn fn) const {
+    Point ra, rb;
+    if (!bounds(a, b, ra, rb)) return true;
+    return tree_.report(ra, rb, [this, &fn](const Point& p) { return fn(elements_[p[0]]); });
+  }
+
+  // As the ones above, within a Box - for DimCmp with coordinate<IthDim>(const V&)
+  template<class T, class M = Mix, class = enable_if_t<is_same<M, CountOnly>::value>>
+  int query(const Box<Dim, T>& box) const {
+    Point ra, rb;
+    return bounds(lowerBound(box), upperBound(box), ra, rb) ? tree_.query(ra, rb) : 0;
+  }
+
+  template<class T, class Fn>
+  bool report(const Box<Dim, T>& box, Fn fn) const {
+    Point ra, rb;
+    if (!bounds(lowerBound(box), upperBound(box), ra, rb)) return true;
+    return tree_.report(ra, rb, [this, &fn](const Point& p) { return fn(elements_[p[0]]); });
+  }
+
+  size_t bytes() const {
+    size_t bytes = tree_.bytes() + elements_.size() * sizeof(V);
+    for (const auto& o : order_)
+      bytes += o.size() * sizeof(Rank);
+    return bytes;
+  }
+
+ private:
+  Tree ranked(unsigned threads) {  assert(!elements_.empty());
+    if (elements_.size() > numeric_limits<Rank>::max())  // Bounds may be one past the last rank
+      throw length_error("Too many elements for the rank type");
+    sort(elements_.begin(), elements_.end(), DimLess<DimCmp, 0>{});
+    vector<Point> points(elements_.size());
+    for (size_t i = 0; i < points.size(); ++i)
+      points[i][0] = i;
+    rank(points, integral_constant<size_t, 1>{});
+    return Tree(std::move(points), threads);
+  }
+
+  // Ties get consecutive ranks; bounds never split them, as they are found by lower_bound
+  template<size_t IthDim>
+  void rank(vector<Point>& points, integral_constant<size_t, IthDim>) {
+    auto& order = order_[IthDim-1];
+    order.resize(elements_.size());
+    iota(order.begin(), order.end(), Rank(0));
+    sort(order.begin(), order.end(), [this](Rank x, Rank y) {
+      return DimLess<DimCmp, IthDim>{}(elements_[x], elements_[y]);
+    });
+    for (size_t p = 0; p < order.size(); ++p)
+      points[order[p]][IthDim] = p;
+    rank(points, integral_constant<size_t, IthDim+1>{});
+  }
+
+  void rank(vector<Point>& /*points*/, integral_constant<size_t, Dim>) {}
+
+  // Ranks of [a, b) - of Vs, or of BoxBounds; false if it is empty in some dimension
+  template<class B>
+  bool bounds(const B& a, const B& b, Point& ra, Point& rb) const {
+    auto ita = branchlessLowerBound(elements_.begin(), elements_.end(), a, DimLess<DimCmp, 0>{});
+    auto itb = branchlessLowerBound(elements_.begin(), elements_.end(), b, DimLess<DimCmp, 0>{});
+    ra[0] = ita - elements_.begin();
+    rb[0] = itb - elements_.begin();
+    return ra[0] < rb[0] && bounds(a, b, ra, rb, integral_constant<size_t, 1>{});
+  }
+
+  template<class B, size_t IthDim>
+  bool bounds(const B& a, const B& b, Point& ra, Point& rb, integral_constant<size_t, IthDim>) const {
+    const auto& order = order_[IthDim-1];
+    auto less = [this](Rank x, const B& v) { return DimLess<DimCmp, IthDim>{}(elements_[x], v); };
+    ra[IthDim] = branchlessLowerBound(order.begin(), order.end(), a, less) - order.begin();
+    rb[IthDim] = branchlessLowerBound(order.begin(), order.end(), b, less) - order.begin();
+    return ra[IthDim] < rb[IthDim] && bounds(a, b, ra, rb, integral_constant<size_t, IthDim+1>{});
+  }
+
+  template<class B>
+  bool bounds(const B& /*a*/, const B& /*b*/, Point& /*ra*/, Point& /*rb*/, integral_constant<size_t, Dim>) const {
+    return true;
+  }
+
+  vector<V> elements_;  // In order of dimension 0, so by their ranks there
+  array<vector<Rank>, Dim-1> order_;  // Elements in order of each dimension above 0, from 1
+  Tree tree_;
+};
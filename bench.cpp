@@ -0,0 +1,341 @@
+// Benchmarks of the trees on their own - no gogui. Every engine is built over every distribution,
+// then queried with boxes of a few selectivities; one row per engine and selectivity, as JSON lines
+// or CSV, so that runs can be compared. With --search, key searches alone are compared instead.
+// Trees are built on --threads threads, so that build times of different numbers can be compared.
+//   ort_bench [--dims 2,3,4] [--n N] [--queries Q] [--seed S] [--threads T] [--format json|csv]
+//             [--quick] [--search]
+#include <includes/header.hpp>
+
+#include "algorithms/structures/ort.hpp"
+#include "algorithms/structures/kd_tree.hpp"
+#include "includes/rss.hpp"
+
+template<size_t Dim>
+using Point = array<double, Dim>;
+
+// Points have a value after their Dim coordinates
+template<size_t Dim>
+struct Cmp {
+  template<size_t IthDim>
+  static bool precedes(const Point<Dim+1>& p1, const Point<Dim+1>& p2) {
+    return p1[IthDim] < p2[IthDim];
+  }
+
+  template<size_t IthDim>
+  static double coordinate(const Point<Dim+1>& p) {
+    return p[IthDim];
+  }
+};
+
+template<size_t Dim>
+struct MaxMix {
+  static constexpr bool idempotent = true;
+  Point<Dim+1> operator()(const Point<Dim+1>& v1, const Point<Dim+1>& v2) const {
+    return v1[Dim] > v2[Dim] ? v1 : v2;
+  }
+};
+
+template<size_t Dim>
+struct SumMix {
+  static constexpr bool invertible = true;
+  Point<Dim+1> operator()(Point<Dim+1> v1, const Point<Dim+1>& v2) const {
+    v1[Dim] += v2[Dim];
+    return v1;
+  }
+  Point<Dim+1> unmix(Point<Dim+1> whole, const Point<Dim+1>& prefix) const {
+    whole[Dim] -= prefix[Dim];
+    return whole;
+  }
+};
+
+enum class Distribution { Uniform, Clustered, Skewed, Duplicates };
+
+const char* name(Distribution d) {
+  switch (d) {
+    case Distribution::Uniform: return "uniform";
+    case Distribution::Clustered: return "clustered";
+    case Distribution::Skewed: return "skewed";
+    case Distribution::Duplicates: return "duplicates";
+  }
+  return "";
+}
+
+struct Config {
+  vector<size_t> dims{2, 3, 4};
+  size_t n = 0;  // 0: defaultN(dim)
+  int queries = 2000;
+  uint64_t seed = 1;
+  unsigned threads = 1;
+  bool csv = false;
+  bool search = false;
+  vector<double> selectivities{1e-4, 1e-2, 1e-1};
+
+  size_t defaultN(size_t dim) const {  // So that every tree fits in a few hundred MB
+    return dim <= 2 ? 100000 : dim == 3 ? 10000 : 2000;
+  }
+};
+
+struct Row {
+  size_t dim, n;
+  string distribution, engine;
+  unsigned threads;
+  double buildSeconds;
+  size_t bytes, peakRss;
+  double selectivity, hits;
+  int64_t checksum;  // Of the results of all the queries - values are integers, so it is exact - the
+                     // same for engines answering the same ones
+  int queries;
+  double qps, p50, p99;  // Latencies in microseconds
+};
+
+void print(const Row& r, bool csv) {
+  static bool header = false;
+  if (csv) {
+    if (!header) cout << "dim,n,distribution,engine,threads,build_s,bytes,peak_rss,selectivity,hits,checksum,queries,qps,p50_us,p99_us\n";
+    header = true;
+    cout << r.dim << ',' << r.n << ',' << r.distribution << ',' << r.engine << ',' << r.threads << ','
+         << r.buildSeconds << ',' << r.bytes << ',' << r.peakRss << ',' << r.selectivity << ',' << r.hits << ','
+         << r.checksum << ',' << r.queries << ',' << r.qps << ',' << r.p50 << ',' << r.p99 << endl;
+    return;
+  }
+  cout << "{\"dim\":" << r.dim << ",\"n\":" << r.n << ",\"distribution\":\"" << r.distribution
+       << "\",\"engine\":\"" << r.engine << "\",\"threads\":" << r.threads << ",\"build_s\":" << r.buildSeconds
+       << ",\"bytes\":" << r.bytes << ",\"peak_rss\":" << r.peakRss << ",\"selectivity\":" << r.selectivity
+       << ",\"hits\":" << r.hits << ",\"checksum\":" << r.checksum << ",\"queries\":" << r.queries << ",\"qps\":" << r.qps << ",\"p50_us\":" << r.p50
+       << ",\"p99_us\":" << r.p99 << "}" << endl;
+}
+
+template<size_t Dim>
+vector<Point<Dim+1>> points(Distribution d, size_t n, mt19937_64& rng) {
+  uniform_real_distribution<double> u(0, 1);
+  normal_distribution<double> spread(0, 0.02);
+  vector<Point<Dim>> centers(16);
+  for (auto& c : centers)
+    for (auto& x : c) x = u(rng);
+
+  vector<Point<Dim+1>> data(n);
+  for (auto& p : data) {
+    const auto& c = centers[rng() % centers.size()];
+    for (size_t x = 0; x < Dim; ++x) {
+      switch (d) {
+        case Distribution::Uniform: p[x] = u(rng); break;
+        case Distribution::Clustered: p[x] = c[x] + spread(rng); break;
+        case Distribution::Skewed: p[x] = pow(u(rng), 4); break;
+        case Distribution::Duplicates: p[x] = floor(u(rng) * 16) / 16; break;
+      }
+    }
+    p[Dim] = floor(u(rng) * 1000);  // Integers, so that sums are exact
+  }
+  return data;
+}
+
+// Boxes taking a fraction selectivity^(1/Dim) of the points in every dimension, by rank - so about
+// selectivity of all of them, if the dimensions are independent, whatever the distribution
+template<size_t Dim>
+vector<Box<Dim>> boxes(const vector<Point<Dim+1>>& data, double selectivity, int count, mt19937_64& rng) {
+  const size_t n = data.size();
+  const size_t span = max<size_t>(1, llround(n * pow(selectivity, 1./Dim)));
+  array<vector<double>, Dim> sorted;
+  for (size_t x = 0; x < Dim; ++x) {
+    for (const auto& p : data) sorted[x].push_back(p[x]);
+    sort(sorted[x].begin(), sorted[x].end());
+  }
+  vector<Box<Dim>> result(count);
+  for (auto& box : result) {
+    for (size_t x = 0; x < Dim; ++x) {
+      const size_t from = rng() % (n - min(span, n) + 1);
+      box.lo[x] = sorted[x][from];
+      box.hi[x] = from + span < n ? sorted[x][from + span] : numeric_limits<double>::infinity();
+    }
+  }
+  return result;
+}
+
+// Builds Tree over data, then runs query(tree, box) over every set of boxes
+template<class Tree, class P, class B, class Query>
+void run(const string& engine, Row row, const vector<P>& data, const vector<vector<B>>& sets,
+         const vector<double>& hits, const Config& config, const Query& query) {
+  resetPeakRss();
+  const auto start = chrono::steady_clock::now();
+  const Tree tree(data, config.threads);
+  row.buildSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  row.peakRss = peakRss();
+  row.bytes = tree.bytes();
+  row.engine = engine;
+
+  for (size_t s = 0; s < sets.size(); ++s) {
+    vector<double> latencies;
+    latencies.reserve(sets[s].size());
+    double checksum = 0;  // Printed, so that queries are not optimized away
+    for (const auto& box : sets[s]) {
+      const auto t = chrono::steady_clock::now();
+      checksum += query(tree, box);
+      latencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - t).count());
+    }
+    const double total = accumulate(latencies.begin(), latencies.end(), 0.);
+    sort(latencies.begin(), latencies.end());
+    row.selectivity = config.selectivities[s];
+    row.hits = hits[s];
+    row.checksum = llround(checksum);
+    row.queries = latencies.size();
+    row.qps = total > 0 ? latencies.size() / total * 1e6 : 0;
+    row.p50 = latencies[latencies.size() / 2];
+    row.p99 = latencies[min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    print(row, config.csv);
+  }
+}
+
+// lower_bound, branchlessLowerBound and eytzingerLowerBound - the searches of ORT's SortedKeys and
+// EytzingerKeys - over the keys of a tree's root, of every size up to n, with the searches of
+// queries - random keys. One row per search and size: ns per search.
+template<size_t Dim>
+void benchSearch(const Config& config) {
+  using P = Point<Dim+1>;
+  using Less = DimLess<Cmp<Dim>, 0>;
+  const size_t top = config.n ? config.n : 10000000;
+  mt19937_64 rng(config.seed);
+  const int searches = max(config.queries, 1<<20);
+  for (size_t n = 1000; n <= top; n *= 10) {
+    vector<P> keys = points<Dim>(Distribution::Uniform, n, rng);
+    sort(keys.begin(), keys.end(), Less{});
+    const vector<P> values = points<Dim>(Distribution::Uniform, min<size_t>(searches, 1<<16), rng);
+    vector<P> eytzinger(n);
+    for (size_t k = 1; k <= n; ++k)
+      eytzinger[k-1] = keys[eytzingerRank(k, n)];
+
+    auto run = [&](const string& search, size_t bytes, const auto& lowerBound) {
+      size_t sum = 0;
+      const auto start = chrono::steady_clock::now();
+      for (int q = 0; q < searches; ++q) sum += lowerBound(values[q % values.size()]);
+      const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      const double ns = seconds / searches * 1e9;
+      if (config.csv) cout << Dim << ',' << n << ',' << search << ',' << bytes << ',' << ns << endl;
+      else cout << "{\"dim\":" << Dim << ",\"n\":" << n << ",\"search\":\"" << search << "\",\"bytes\":" << bytes
+                << ",\"ns\":" << ns << "}" << endl;
+      return sum;
+    };
+    const size_t bytes = n * sizeof(P);
+    const size_t expected = run("std", bytes, [&keys](const P& v) {
+      return lower_bound(keys.begin(), keys.end(), v, Less{}) - keys.begin();
+    });
+    const size_t branchless = run("branchless", bytes, [&keys](const P& v) {
+      return branchlessLowerBound(keys.begin(), keys.end(), v, Less{}) - keys.begin();
+    });
+    const size_t eytz = run("eytzinger", bytes, [&eytzinger](const P& v) {
+      return eytzingerLowerBound(eytzinger.data(), eytzinger.size(), v, Less{});
+    });
+    if (branchless != expected || eytz != expected) throw logic_error("Searches disagree");
+  }
+}
+
+template<size_t Dim>
+void bench(const Config& config) {
+  using P = Point<Dim+1>;
+  using E = EmptyTrans<P>;
+  const size_t n = config.n ? config.n : config.defaultN(Dim);
+  mt19937_64 rng(config.seed);
+
+  for (Distribution d : {Distribution::Uniform, Distribution::Clustered, Distribution::Skewed, Distribution::Duplicates}) {
+    const vector<P> data = points<Dim>(d, n, rng);
+    vector<vector<Box<Dim>>> sets;
+    for (double s : config.selectivities)
+      sets.push_back(boxes<Dim>(data, s, config.queries, rng));
+
+    vector<double> hits;  // Mean number of points within the boxes of each set
+    {
+      const ORT<Dim, P, Cmp<Dim>, CountOnly, E> counter(data);
+      for (const auto& set : sets) {
+        double total = 0;
+        for (const auto& box : set) total += counter.query(box);
+        hits.push_back(total / set.size());
+      }
+    }
+
+    Row row{};
+    row.dim = Dim;
+    row.n = n;
+    row.distribution = name(d);
+    row.threads = config.threads;
+    auto aggregate = [](const auto& tree, const Box<Dim>& box) {
+      bool any;
+      const P v = tree.query(box, any);
+      return any ? v[Dim] : 0.;
+    };
+    run<ORT<Dim, P, Cmp<Dim>, MaxMix<Dim>, E>>("ort-max", row, data, sets, hits, config, aggregate);
+    run<ORT<Dim, P, Cmp<Dim>, MaxMix<Dim>, E, 0, EytzingerKeys>>("ort-max-eytzinger", row, data, sets, hits, config, aggregate);
+    run<ORT<Dim, P, Cmp<Dim>, Updatable<MaxMix<Dim>>, E>>("ort-max-segtree", row, data, sets, hits, config, aggregate);
+    run<ORT<Dim, P, Cmp<Dim>, SumMix<Dim>, E>>("ort-sum", row, data, sets, hits, config, aggregate);
+    run<ORT<Dim, P, Cmp<Dim>, CountOnly, E>>("ort-count", row, data, sets, hits, config,
+      [](const ORT<Dim, P, Cmp<Dim>, CountOnly, E>& tree, const Box<Dim>& box) { return tree.query(box); });
+    run<ORT<Dim, P, Cmp<Dim>, CountOnly, E, 0, EytzingerKeys>>("ort-count-eytzinger", row, data, sets, hits, config,
+      [](const ORT<Dim, P, Cmp<Dim>, CountOnly, E, 0, EytzingerKeys>& tree, const Box<Dim>& box) { return tree.query(box); });
+    run<ORT<Dim, P, Cmp<Dim>, ReportOnly, E>>("ort-report", row, data, sets, hits, config,
+      [](const ORT<Dim, P, Cmp<Dim>, ReportOnly, E>& tree, const Box<Dim>& box) {
+        double sum = 0;
+        tree.report(box, [&sum](const P& p) { sum += p[Dim]; return true; });
+        return sum;
+      });
+    run<KDTree<Dim, P, Cmp<Dim>, MaxMix<Dim>>>("kd-max", row, data, sets, hits, config, aggregate);
+  }
+}
+
+Config parse(int argc, char** argv) {
+  Config config;
+  for (int i = 1; i < argc; ++i) {
+    const string arg = argv[i];
+    auto value = [&]() -> string {
+      if (i+1 >= argc) throw invalid_argument("Missing value of " + arg);
+      return argv[++i];
+    };
+    if (arg == "--dims") {
+      config.dims.clear();
+      stringstream list(value());
+      for (string d; getline(list, d, ',');) config.dims.push_back(stoul(d));
+    } else if (arg == "--n") {
+      config.n = stoul(value());
+    } else if (arg == "--queries") {
+      config.queries = stoi(value());
+    } else if (arg == "--seed") {
+      config.seed = stoull(value());
+    } else if (arg == "--threads") {
+      config.threads = stoul(value());
+    } else if (arg == "--format") {
+      const string format = value();
+      if (format != "json" && format != "csv") throw invalid_argument("Unknown format " + format);
+      config.csv = format == "csv";
+    } else if (arg == "--quick") {
+      config.n = 2000;
+      config.queries = 200;
+    } else if (arg == "--search") {
+      config.search = true;
+    } else {
+      throw invalid_argument("Unknown option " + arg);
+    }
+  }
+  if (config.queries <= 0) throw invalid_argument("--queries must be positive");
+  if (config.threads == 0) throw invalid_argument("--threads must be positive");
+  return config;
+}
+
+int main(int argc, char** argv) {
+  Config config;
+  try {
+    config = parse(argc, argv);
+  } catch (const exception& e) {
+    cerr << e.what() << "\nUsage: " << argv[0]
+         << " [--dims 2,3,4] [--n N] [--queries Q] [--seed S] [--threads T] [--format json|csv] [--quick] [--search]"
+         << endl;
+    return 2;
+  }
+  if (config.search && config.csv) cout << "dim,n,search,bytes,ns" << endl;
+  for (size_t dim : config.dims) {
+    switch (dim) {
+      case 1: config.search ? benchSearch<1>(config) : bench<1>(config); break;
+      case 2: config.search ? benchSearch<2>(config) : bench<2>(config); break;
+      case 3: config.search ? benchSearch<3>(config) : bench<3>(config); break;
+      case 4: config.search ? benchSearch<4>(config) : bench<4>(config); break;
+      case 5: config.search ? benchSearch<5>(config) : bench<5>(config); break;
+      default: cerr << "Dimensions 1 to 5 only, not " << dim << endl; return 2;
+    }
+  }
+}
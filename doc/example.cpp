@@ -21,5 +21,5 @@ struct MaxFn {
 };
 
 auto createMax3DTree(const std::vector<NDPoint<4>>& data) {
-  return ORT<3, NDPoint<4>, DimCmpSingle<3>> tree(data, MaxFn<3>{});
+  return ORT<3, NDPoint<4>, DimCmpSingle<3>, MaxFn<3>, EmptyTrans<NDPoint<4>>>(data);
 }
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <includes/header.hpp>
+
+// Peak resident memory of the process since the last resetPeakRss(), from /proc; 0 if unknown
+inline size_t peakRss() {
+  ifstream status("/proc/self/status");
+  string line;
+  while (getline(status, line))
+    if (line.compare(0, 6, "VmHWM:") == 0) return stoull(line.substr(6)) * 1024;
+  return 0;
+}
+
+inline void resetPeakRss() {
+  ofstream("/proc/self/clear_refs") << "5";
+}
@@ -8,6 +8,11 @@
 #include <unordered_set>
 
 #include "algorithms/structures/ort.hpp"
+#include "algorithms/structures/dynamic_ort.hpp"
+#include "algorithms/structures/concurrent_ort.hpp"
+#include "algorithms/structures/rank_ort.hpp"
+#include "algorithms/structures/range_index.hpp"
+#include "includes/rss.hpp"
 
 using gogui::Point;
 using gogui::Line;
@@ -16,6 +21,30 @@ using namespace gogui::utils;
 template<size_t Dim>
 using NDPoint = std::array<double, Dim>;
 
+// Heap allocations made so far, to check that queries make none. Every replaceable form is defined,
+// in terms of the plain ones, and those stay out of line: inlined, free() would be seen taking what
+// operator new returned.
+std::atomic<size_t> allocations{0};
+
+__attribute__((noinline)) void* operator new(size_t size) {
+  ++allocations;
+  if (void* p = malloc(size)) return p;
+  throw std::bad_alloc();
+}
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try { return operator new(size); } catch (const std::bad_alloc&) { return nullptr; }
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return operator new(size, std::nothrow);
+}
+void operator delete[](void* p) noexcept { operator delete(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+void operator delete[](void* p, size_t) noexcept { operator delete(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { operator delete(p); }
+
 
 template<size_t Dim>
 struct DimCmpSingle {
@@ -23,6 +52,11 @@ struct DimCmpSingle {
   static bool precedes(const NDPoint<Dim>& p1, const NDPoint<Dim>& p2) {
     return p1[IthDim] < p2[IthDim];
   }
+
+  template<size_t IthDim>
+  static double coordinate(const NDPoint<Dim>& p) {
+    return p[IthDim];
+  }
 };
 
 template<size_t Dim>
@@ -33,6 +67,11 @@ struct DimCmpInVec {
     assert(p2.size() == 1);
     return DimCmpSingle<Dim>{}.template precedes<IthDim>(p1.front(), p2.front());
   }
+
+  template<size_t IthDim>
+  static double coordinate(const vector<NDPoint<Dim>>& p) {
+    return p.front()[IthDim];
+  }
 };
 
 template<size_t Dim>
@@ -58,19 +97,46 @@ struct SumOfPointsTrans {
 template<size_t Dim>
 struct MaxValueMix {
   using V = NDPoint<Dim+1>;
+  static constexpr bool idempotent = true;
   V operator()(V v1, V v2) {
     return v1[Dim] > v2[Dim] ? v1 : v2;
   }
 };
 
+// The order MaxValueMix picks by, for top()
+template<size_t Dim>
+struct GreaterValue {
+  bool operator()(const NDPoint<Dim+1>& v1, const NDPoint<Dim+1>& v2) const {
+    return v1[Dim] > v2[Dim];
+  }
+};
+
+// Sums the values, kept in the last coordinate of the first point
+template<size_t Dim>
+struct SumOfValuesMix {
+  using V = NDPoint<Dim+1>;
+  static constexpr bool invertible = true;
+  V operator()(V v1, const V& v2) {
+    v1[Dim] += v2[Dim];
+    return v1;
+  }
+  V unmix(V whole, const V& prefix) {
+    whole[Dim] -= prefix[Dim];
+    return whole;
+  }
+};
+
+// Adds delta to the values of a range, as ORT::apply
 template<size_t Dim>
 struct MaxValueTrans {
-  NDPoint<Dim+1>  combine(NDPoint<Dim+1> v, int /*len*/) { return v; }
-  void apply(NDPoint<Dim+1> * /*v*/, int /*dx*/) { }
-  void compose(MaxValueTrans* /*t*/) { }
+  NDPoint<Dim+1> combine(NDPoint<Dim+1> v, int /*len*/) { v[Dim] += delta; return v; }
+  void apply(NDPoint<Dim+1>* v, int /*dx*/) { (*v)[Dim] += delta; }
+  void compose(MaxValueTrans* t) { t->delta += delta; }
   MaxValueTrans move(int /*dx*/, int /*dl*/) { return *this; }
   static MaxValueTrans neutral() { return MaxValueTrans{}; }
-  bool isNeutral() const { return true; }
+  bool isNeutral() const { return delta == 0; }
+
+  double delta = 0;
 };
 
 template<class V>
@@ -122,11 +188,25 @@ struct Debugger {
   }
 };
 
+// Counts the structures queries search, of any level, whatever their bounds
+struct StructureCounter {
+  template<class B>
+  void onQueryStart(size_t /*dim*/, const B& /*a*/, const B& /*b*/) { ++structures; }
+
+  template<class K>
+  void onPerspectiveSet(size_t /*dim*/, const K& /*ka*/, const K& /*kb*/) {}
+
+  template<class K>
+  void onLastDimFound(const K& /*k*/) {}
+
+  size_t structures = 0;
+};
+
 template<class T>
 T timer(const std::string& label, const std::function<T()>& fn) {
-  const auto start = std::chrono::system_clock::now();
+  const auto start = std::chrono::steady_clock::now();
   T v = fn();
-  const auto end = std::chrono::system_clock::now();
+  const auto end = std::chrono::steady_clock::now();
   const std::chrono::duration<double> dt = end-start;
   std::cout << label << ": " << dt.count() << endl;
   return v;
@@ -137,13 +217,55 @@ void timer(const std::string& label, const std::function<void()>& fn) {
   timer(label, function<bool()>([fn] { fn(); return true; }));
 }
 
+template<size_t Dim>
+struct RandomPointCreator {
+  NDPoint<Dim> operator()() const {
+    NDPoint<Dim> p;
+    for (size_t x = 0; x<Dim; ++x)
+      p[x] = static_cast<double>(rand())/RAND_MAX;
+    return p;
+  }
+};
+
+template<size_t Dim>
+vector<NDPoint<Dim>> randomPoints(size_t n) {
+  vector<NDPoint<Dim>> points;
+  for (size_t i = 0; i < n; ++i)
+    points.push_back(RandomPointCreator<Dim>{}());
+  return points;
+}
+
+// Bounds [a, b) of a box of side dx at random within the unit cube, in the first Dim coordinates of
+// P - the rest are 0. About n dx^Dim of n random points are within.
+template<size_t Dim, class P = NDPoint<Dim>>
+struct RandomBoxCreator {
+  double dx;
+
+  pair<P, P> operator()() const {
+    P a{}, b{};
+    for (size_t x = 0; x<Dim; ++x) {
+      a[x] = (static_cast<double>(rand())/RAND_MAX) * (1-dx);
+      b[x] = a[x] + dx;
+    }
+    return {a, b};
+  }
+};
+
+// Whether the first Dim coordinates of p are within [a, b), or [a, b] if closed - as queries see it
+template<size_t Dim, class P, class B>
+bool within(const P& p, const B& a, const B& b, bool closed = false) {
+  for (size_t x = 0; x<Dim; ++x)
+    if (p[x] < a[x] || (closed ? b[x] < p[x] : b[x] <= p[x])) return false;
+  return true;
+}
+
 template<size_t Dim, class DimCmp, class Mix, class Trans>
 void testConstruction(
     const size_t n,
     const function<typename Mix::V()>& pointCreator,
     const function<typename Mix::V(array<double, Dim>)> queryPointCreator) {
   using V = typename Mix::V;
-  using O = ORT<Dim, V, DimCmp, Trans>;   
+  using O = ORT<Dim, V, DimCmp, Mix, Trans>;   
   
   const auto data = timer("  Creating points", function<vector<V>()>([n, &pointCreator] {
     vector<V> data;
@@ -154,27 +276,49 @@ void testConstruction(
   }));
   
   O tree = timer("  Constructing tree", function<O()>([&data] {
-    return O(data, Mix{});
+    return O(data);
   }));
+
+  {
+    const O parallelTree = timer("  Constructing tree on all cores", function<O()>([&data] {
+      return O(data, max(2u, thread::hardware_concurrency()));  // Forking even on a single core
+    }));
+    assert(parallelTree.getAll() == tree.getAll());
+    // Laid out the same, so mixing the same values in the same order
+    const RandomBoxCreator<Dim> randomBox{std::pow(100./n, 1./Dim)};
+    for (int q = 0; q < 1000; ++q) {
+      std::array<double, Dim> a, b;
+      tie(a, b) = randomBox();
+      bool any, parallelAny;
+      const V v = tree.query(queryPointCreator(a), queryPointCreator(b), any);
+      const V w = parallelTree.query(queryPointCreator(a), queryPointCreator(b), parallelAny);
+      assert(any == parallelAny);
+      assert(!any || v == w);
+    }
+  }
   
   auto queryFnFactory = [n, &tree, &queryPointCreator](double expected, size_t queries) -> function<void()> {
-    const double dx = std::pow(expected/n, 1./Dim);
-    return [dx, queries, &tree, &queryPointCreator]() mutable {
+    const RandomBoxCreator<Dim> randomBox{std::pow(expected/n, 1./Dim)};
+    return [randomBox, queries, &tree, &queryPointCreator]() mutable {
       while (queries--) {
-        std::array<double, Dim> a, b;      
-        for (size_t x = 0; x<Dim; ++x) {
-          a[x] = (static_cast<double>(rand())/RAND_MAX) * (1-dx);
-          b[x] = a[x] + dx;
-        }      
+        std::array<double, Dim> a, b;
+        tie(a, b) = randomBox();
         bool any;
         const V result = tree.query(queryPointCreator(a), queryPointCreator(b), any);
       }
     };
   };
   
-  timer("  1000 small queries (expected 10 points)", queryFnFactory(10, 1));
-  timer("  1000 med queries (expected 100 points)", queryFnFactory(100, 1));
-  timer("  1000 big queries (expected 1000 points)", queryFnFactory(1000, 1));
+  timer("  1000 small queries (expected 10 points)", queryFnFactory(10, 1000));
+  timer("  1000 med queries (expected 100 points)", queryFnFactory(100, 1000));
+  timer("  1000 big queries (expected 1000 points)", queryFnFactory(1000, 1000));
+
+  if (is_trivially_copyable<V>::value) {  // Otherwise mixing values allocates by itself
+    auto queries = queryFnFactory(100, 1000);
+    const size_t before = allocations;
+    queries();
+    assert(allocations == before);
+  }
 }
 
 template<size_t Dim, class DimCmp, class Mix, class Trans>
@@ -188,16 +332,6 @@ void testConstruction(
   }
 }
 
-template<size_t Dim>
-struct RandomPointCreator {
-  NDPoint<Dim> operator()() const {
-    NDPoint<Dim> p;
-    for (size_t x = 0; x<Dim; ++x)
-      p[x] = static_cast<double>(rand())/RAND_MAX;
-    return p;
-  }
-};
-
 template<size_t Dim>
 struct RandomPointCreatorInVec {
   vector<NDPoint<Dim>> operator()() const {
@@ -241,6 +375,927 @@ void testConstructionForMax(const std::initializer_list<size_t>& ns) {
   );
 }
 
+// Max as the GSegTrees at the last level take it, rather than a SparseTable
+template<size_t Dim>
+void testConstructionForUpdatableMax(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = updatable max: " << std::endl;
+  testConstruction<Dim, DimCmpSingle<Dim+1>, Updatable<MaxValueMix<Dim>>, MaxValueTrans<Dim>>(
+    ns,
+    RandomPointCreator<Dim+1>{},
+    QueryPointCreatorValued<Dim>{}
+  );
+}
+
+template<size_t Dim>
+void testReporting(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D reporting only: " << std::endl;
+  using V = NDPoint<Dim>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim>, ReportOnly, EmptyTrans<V>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim>(n);
+
+    const O tree = timer("  Constructing tree", function<O()>([&data] {
+      return O(data);
+    }));
+    std::cout << "  Bytes: " << tree.bytes() << endl;
+
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+    timer("  1000 reports (expected 100 points)", function<void()>([randomBox, &tree] {
+      for (int q = 0; q < 1000; ++q) {
+        V a, b;
+        tie(a, b) = randomBox();
+        size_t found = 0;
+        tree.report(a, b, [&found](const V&) { ++found; return true; });
+      }
+    }));
+  }
+}
+
+template<size_t Dim>
+void testCounting(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D counting only: " << std::endl;
+  using V = NDPoint<Dim>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim>, CountOnly, EmptyTrans<V>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim>(n);
+
+    const O tree = timer("  Constructing tree", function<O()>([&data] {
+      return O(data);
+    }));
+    std::cout << "  Bytes: " << tree.bytes() << endl;
+    const ORTStats stats = tree.stats();  // No GSegTree nodes in the last two levels
+    assert(stats.levels[0].nodes == 0 && stats.levels[min<size_t>(Dim-1, 1)].nodes == 0);
+
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+    timer("  1000 counts (expected 100 points)", function<void()>([randomBox, &tree] {
+      for (int q = 0; q < 1000; ++q) {
+        V a, b;
+        tie(a, b) = randomBox();
+        tree.query(a, b);
+      }
+    }));
+  }
+}
+
+template<size_t Dim>
+void testDynamic(const std::initializer_list<size_t>& ns) {
+  std::cout << "Dynamic ORT " << Dim << "D with Mix = max: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = DynamicORT<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, MaxValueTrans<Dim>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+
+    O tree;
+    timer("  Inserting one by one", function<void()>([&data, &tree] {
+      for (const V& v : data)
+        tree.insert(v);
+    }));
+    assert(tree.size() == int(n));
+
+    timer("  Erasing half", function<void()>([&data, &tree] {
+      for (size_t i = 0; i < data.size(); i += 2) {
+        const bool erased = tree.erase(data[i]);
+        assert(erased);
+      }
+    }));
+    assert(tree.size() == int(n/2));
+
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+    timer("  1000 queries (expected 50 points)", function<void()>([randomBox, &data, &tree] {
+      for (int q = 0; q < 1000; ++q) {
+        V a, b;
+        tie(a, b) = randomBox();
+        bool any;
+        const V v = tree.query(a, b, any);
+
+        bool expectedAny = false;
+        double expected = 0;
+        for (size_t i = 1; i < data.size(); i += 2) {
+          if (!within<Dim>(data[i], a, b)) continue;
+          expected = expectedAny ? max(expected, data[i][Dim]) : data[i][Dim];
+          expectedAny = true;
+        }
+        assert(any == expectedAny);
+        assert(!any || v[Dim] == expected);
+      }
+    }));
+  }
+}
+
+// Erasing from trees with EmptyTrans, which asserts that it is never called, static and dynamic
+template<size_t Dim>
+void testErase(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = max and no Trans, erasing: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, Updatable<MaxValueMix<Dim>>, EmptyTrans<V>>;
+  using D = DynamicORT<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, EmptyTrans<V>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+    O tree(data);
+    D dynamic;
+    for (const V& v : data)
+      dynamic.insert(v);
+    timer("  Erasing half", function<void()>([&] {
+      for (size_t i = 0; i < data.size(); i += 2) {
+        const bool erased = tree.erase(data[i]) && dynamic.erase(data[i]);
+        assert(erased);
+      }
+    }));
+
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+    for (int q = 0; q < 1000; ++q) {
+      V a, b;
+      tie(a, b) = randomBox();
+      bool expectedAny = false;
+      double expected = 0;
+      for (size_t i = 1; i < data.size(); i += 2) {
+        if (!within<Dim>(data[i], a, b)) continue;
+        expected = expectedAny ? max(expected, data[i][Dim]) : data[i][Dim];
+        expectedAny = true;
+      }
+      bool any, dynamicAny;
+      const V v = tree.query(a, b, any);
+      const V w = dynamic.query(a, b, dynamicAny);
+      assert(any == expectedAny && dynamicAny == expectedAny);
+      assert(!any || (v[Dim] == expected && w[Dim] == expected));
+    }
+  }
+}
+
+template<size_t Dim>
+void testApply(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = max, adding to values: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, Updatable<MaxValueMix<Dim>>, MaxValueTrans<Dim>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+    for (V& v : data)
+      v[Dim] = rand() % 1000;  // Integers, to be added up exactly in any order
+    O tree(data);
+
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+    timer("  1000 applies and queries (expected 100 points)", function<void()>([&] {
+      for (int q = 0; q < 1000; ++q) {
+        V a, b;
+        tie(a, b) = randomBox();
+        MaxValueTrans<Dim> t;
+        t.delta = rand() % 21 - 10;
+        tree.apply(a, b, t);
+        for (V& v : data)
+          if (within<Dim>(v, a, b)) v[Dim] += t.delta;
+
+        tie(a, b) = randomBox();
+        bool any;
+        const V v = tree.query(a, b, any);
+        bool expectedAny = false;
+        double expected = 0;
+        for (const V& w : data) {
+          if (!within<Dim>(w, a, b)) continue;
+          expected = expectedAny ? max(expected, w[Dim]) : w[Dim];
+          expectedAny = true;
+        }
+        assert(any == expectedAny);
+        assert(!any || v[Dim] == expected);
+      }
+    }));
+  }
+}
+
+template<size_t Dim>
+void testConcurrentQueries(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = max, queried by many threads: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, Updatable<MaxValueMix<Dim>>, MaxValueTrans<Dim>>;
+  const unsigned threads = max(2u, thread::hardware_concurrency());
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+    O tree(data);
+    V lo, hi;
+    lo.fill(-1);
+    hi.fill(2);
+    MaxValueTrans<Dim> t;
+    t.delta = 1;
+    tree.apply(lo, hi, t);  // So that queries have pending Trans to follow
+
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+    vector<pair<V, V>> queries(1000);
+    vector<V> expected;
+    for (auto& q : queries) {
+      q = randomBox();
+      bool any;
+      expected.push_back(tree.query(q.first, q.second, any));
+    }
+
+    timer("  1000 queries on every thread, one tree", function<void()>([&] {
+      vector<thread> readers;
+      for (unsigned r = 0; r < threads; ++r)
+        readers.emplace_back([&] {
+          for (size_t q = 0; q < queries.size(); ++q) {
+            bool any;
+            const V v = tree.query(queries[q].first, queries[q].second, any);
+            assert(v == expected[q]);
+          }
+        });
+      for (auto& r : readers) r.join();
+    }));
+
+    ConcurrentORT<O> shared(tree);
+    bool any;
+    const double top = tree.query(lo, hi, any)[Dim];
+    timer("  100 updates, published while read", function<void()>([&] {
+      atomic<bool> done{false};
+      vector<thread> readers;
+      for (unsigned r = 0; r+1 < threads; ++r)
+        readers.emplace_back([&] {
+          double last = top;
+          while (!done) {
+            bool any;
+            const double v = shared.get()->query(lo, hi, any)[Dim];
+            assert(v >= last);  // Versions only grow, and each one is whole
+            last = v;
+          }
+        });
+      for (int u = 0; u < 100; ++u)
+        shared.update([&](O& o) { o.apply(lo, hi, t); });
+      done = true;
+      for (auto& r : readers) r.join();
+    }));
+    assert(shared.get()->query(lo, hi, any)[Dim] == top + 100);
+  }
+}
+
+template<size_t Dim>
+void testSnapshots(const std::initializer_list<size_t>& ns) {
+  std::cout << "Dynamic ORT " << Dim << "D with Mix = max, snapshots: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = DynamicORT<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, MaxValueTrans<Dim>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+
+    O tree;
+    for (const V& v : data)
+      tree.insert(v);
+
+    V lo, hi;
+    lo.fill(-1);
+    hi.fill(2);
+    bool any;
+    const V top = tree.query(lo, hi, any);
+
+    const O snapshot = timer("  Taking a snapshot", function<O()>([&tree] { return tree; }));
+    timer("  Erasing the top one, 100 inserts", function<void()>([&] {
+      const bool erased = tree.erase(top);
+      assert(erased);
+      for (int i = 0; i < 100; ++i)
+        tree.insert(RandomPointCreator<Dim+1>{}());
+    }));
+    std::cout << "  Bytes: " << tree.bytes() << ", shared with the snapshot: " << tree.bytesSharedWith(snapshot) << endl;
+
+    assert(snapshot.size() == int(n));
+    assert(tree.size() == int(n) + 99);
+    assert(snapshot.query(lo, hi, any) == top);
+    assert(snapshot.contains(top) && !tree.contains(top));
+
+    tree = snapshot;  // Rollback
+    assert(tree.size() == int(n));
+    assert(tree.query(lo, hi, any) == top);
+
+    // Of data[from, n), against what the version finds
+    auto check = [&data, n](const O& version, size_t from) {
+      for (int q = 0; q < 1000; ++q) {
+        V a, b;
+        tie(a, b) = RandomBoxCreator<Dim, V>{0.2}();
+        bool any;
+        const V v = version.query(a, b, any);
+        size_t inside = 0;
+        double best = -1;
+        for (size_t i = from; i < n; ++i)
+          if (within<Dim>(data[i], a, b)) ++inside, best = max(best, data[i][Dim]);
+        assert(any == (inside > 0));
+        assert(!any || v[Dim] == best);
+        size_t reported = 0;
+        version.report(a, b, [&reported](const V&) { ++reported; return true; });
+        assert(reported == inside);
+      }
+    };
+
+    // Tombstones in a single tree of all, shared with another version: it is not copied
+    data.back() = data[0];  // So that one of the two is left
+    O whole(data);
+    const size_t bytes = whole.bytes();
+    O version = whole;
+    const size_t tombstones = O::MaxTombstones;
+    for (size_t i = 0; i < tombstones; ++i) {
+      const bool erased = version.erase(data[i]);
+      assert(erased);
+    }
+    assert(version.bytesSharedWith(whole) == bytes);
+    assert(version.bytes() == bytes + tombstones * sizeof(V));
+    assert(version.size() == int(n - tombstones) && whole.size() == int(n));
+    assert(version.contains(data[0]) && !version.contains(data[1]) && whole.contains(data[1]));
+    check(version, tombstones);
+    check(whole, 0);
+
+    // Queries of a quarter of the elements search the tree around the tombstones within, not
+    // through what it reports: as many structures as a query of the whole tree does for each
+    const RandomBoxCreator<Dim, V> randomBox{0.5};
+    vector<pair<V, V>> boxes(1000);
+    for (auto& box : boxes)
+      box = randomBox();
+    vector<size_t> searched(boxes.size()), searchedAround(boxes.size());
+    timer("  1000 queries of a quarter of the elements", function<void()>([&] {
+      for (size_t q = 0; q < boxes.size(); ++q) {
+        StructureCounter counter;
+        whole.query(boxes[q].first, boxes[q].second, any, counter);
+        searched[q] = counter.structures;
+      }
+    }));
+    timer("  The same ones, with tombstones", function<void()>([&] {
+      for (size_t q = 0; q < boxes.size(); ++q) {
+        StructureCounter counter;
+        version.query(boxes[q].first, boxes[q].second, any, counter);
+        searchedAround[q] = counter.structures;
+      }
+    }));
+    const size_t most = *max_element(searched.begin(), searched.end());
+    for (size_t q = 0; q < boxes.size(); ++q) {
+      size_t cuts = 0;
+      for (size_t i = 0; i < tombstones; ++i)
+        cuts += within<Dim>(data[i], boxes[q].first, boxes[q].second);
+      assert(searchedAround[q] <= (cuts + 1) * most);
+    }
+
+    // Past MaxTombstones, the tree is rebuilt for this version alone, and erased from in place
+    timer("  Erasing a quarter of it", function<void()>([&] {
+      for (size_t i = tombstones; i < n/4; ++i) {
+        const bool erased = version.erase(data[i]);
+        assert(erased);
+      }
+    }));
+    std::cout << "  Bytes: " << version.bytes() << ", shared with the other version: "
+              << version.bytesSharedWith(whole) << endl;
+    assert(version.bytesSharedWith(whole) == 0);
+    assert(version.size() == int(n - n/4) && whole.size() == int(n));
+    check(version, n/4);
+    check(whole, 0);
+  }
+}
+
+template<size_t Dim>
+void testFile(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = max, saved and mapped: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, MaxValueTrans<Dim>>;
+  const string path = "ort" + to_string(Dim) + "d.bin";
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+
+    const O tree = timer("  Constructing tree", function<O()>([&data] {
+      return O(data);
+    }));
+    timer("  Saving", function<void()>([&] { tree.save(path); }));
+    const O mapped = timer("  Mapping, checksum verified", function<O()>([&] { return O::load(path); }));
+    timer("  Mapping", function<void()>([&] { O::load(path, false); }));
+
+    for (int q = 0; q < 1000; ++q) {
+      V a, b;
+      tie(a, b) = RandomBoxCreator<Dim, V>{0.1}();
+      bool any, mappedAny;
+      const V v = tree.query(a, b, any);
+      const V w = mapped.query(a, b, mappedAny);
+      assert(any == mappedAny);
+      assert(!any || v == w);
+    }
+  }
+  remove(path.c_str());
+}
+
+// Mapping takes no memory upfront, so a file larger than physical memory maps - here a sparse one
+void testMapLarge() {
+  const size_t bytes = size_t(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE) * 4;
+  std::cout << "Mapping " << (bytes >> 20) << " MB, four times memory" << std::endl;
+  const string path = "large.bin";
+  {
+    const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    const bool sized = ftruncate(fd, bytes) == 0;
+    close(fd);
+    assert(sized);
+  }
+  assert(Arena::map(path, 0, bytes).size() == bytes);
+  remove(path.c_str());
+}
+
+// Built from a file, within an eighth of the memory the elements take, into a file - the same one
+// save makes of a tree built in memory
+template<size_t Dim>
+void testExternalBuild(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = max, built from a file into a file: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, EmptyTrans<V>>;
+  using C = ORT<Dim, V, DimCmpSingle<Dim+1>, CountOnly, EmptyTrans<V>>;
+  const string input = "points" + to_string(Dim) + "d.bin";
+  const string path = "ort" + to_string(Dim) + "d.bin", saved = "ort" + to_string(Dim) + "d.saved.bin";
+  const string countPath = "ort" + to_string(Dim) + "d.count.bin";
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+    vector<size_t> order(n);  // No ties in the dimension sorted first, so that the two trees are the same
+    iota(order.begin(), order.end(), 0);
+    random_shuffle(order.begin(), order.end());
+    for (size_t i = 0; i < n; ++i)
+      data[i][Dim-1] = (order[i] + 0.5) / n;
+    std::ofstream(input, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), n * sizeof(V));
+
+    const size_t memory = n * sizeof(V) / 8;
+    resetPeakRss();
+    const size_t before = peakRss();
+    const O built = timer("  Building into a file", function<O()>([&] {
+      return O::build(input, path, memory);
+    }));
+    const size_t peak = peakRss();
+    std::cout << "  Resident while building: " << (peak - before) / 1024 << "kB, within "
+              << memory / 1024 << "kB" << std::endl;
+    // On top of memory: the code and buffers building touches first, and what it fills in one go
+    assert(peak - before <= memory + (8 << 20));
+    const O tree = timer("  Constructing tree", function<O()>([&data] {
+      return O(data);
+    }));
+    tree.save(saved);
+    std::ifstream f1(path, std::ios::binary), f2(saved, std::ios::binary);
+    assert(std::equal(std::istreambuf_iterator<char>(f1), std::istreambuf_iterator<char>(),
+                      std::istreambuf_iterator<char>(f2), std::istreambuf_iterator<char>()));
+    O::load(path);
+
+    const C counting = C::build(input, countPath, memory);
+    C(data).save(saved);
+    std::ifstream f3(countPath, std::ios::binary), f4(saved, std::ios::binary);
+    assert(std::equal(std::istreambuf_iterator<char>(f3), std::istreambuf_iterator<char>(),
+                      std::istreambuf_iterator<char>(f4), std::istreambuf_iterator<char>()));
+
+    for (int q = 0; q < 1000; ++q) {
+      V a, b;
+      tie(a, b) = RandomBoxCreator<Dim, V>{0.1}();
+      bool any, builtAny;
+      const V v = tree.query(a, b, any);
+      const V w = built.query(a, b, builtAny);
+      assert(any == builtAny);
+      assert(!any || v == w);
+      int c = 0;
+      double best = -1;
+      for (const V& p : data)
+        if (within<Dim>(p, a, b)) ++c, best = max(best, p[Dim]);
+      assert(any == (c > 0));
+      assert(!any || v[Dim] == best);
+      assert(counting.query(a, b, any) == c);
+    }
+  }
+  remove(input.c_str());
+  remove(path.c_str());
+  remove(countPath.c_str());
+  remove(saved.c_str());
+}
+
+// Within memory for a hundredth of the elements, merged four runs at a time: over several passes
+void testExternalSort(size_t n) {
+  std::cout << "External sort of " << n << " numbers" << std::endl;
+  const string input = "numbers.bin";
+  vector<int> data(n);
+  for (int& v : data)
+    v = rand();
+  std::ofstream(input, std::ios::binary).write(reinterpret_cast<const char*>(data.data()), n * sizeof(int));
+  vector<int> sorted;
+  const size_t sortedCount = externalSort<int, less<int>>(input, input, n * sizeof(int) / 100, [&sorted](int v) {
+    sorted.push_back(v);
+  }, 4);
+  assert(sortedCount == n);
+  sort(data.begin(), data.end());
+  assert(sorted == data);
+  for (int r = 0; r < 200; ++r)
+    assert(!std::ifstream(input + ".run" + to_string(r)));
+  remove(input.c_str());
+}
+
+template<size_t Dim, class Rank>
+void testRankSpace(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D reporting only, in rank space of " << sizeof(Rank) * 8 << " bits: " << std::endl;
+  using V = NDPoint<Dim>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim>, ReportOnly, EmptyTrans<V>>;
+  using R = RankSpaceORT<Dim, V, DimCmpSingle<Dim>, ReportOnly, Rank>;
+  using C = RankSpaceORT<Dim, V, DimCmpSingle<Dim>, CountOnly, Rank>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim>(n);
+
+    const O plain(data);
+    const R ranked = timer("  Constructing tree", function<R()>([&data] {
+      return R(data);
+    }));
+    std::cout << "  Bytes: " << ranked.bytes() << ", of coordinates: " << plain.bytes() << endl;
+
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+    timer("  1000 reports (expected 100 points)", function<void()>([&] {
+      for (int q = 0; q < 1000; ++q) {
+        V a, b;
+        tie(a, b) = randomBox();
+        double sum = 0;
+        ranked.report(a, b, [&sum](const V& v) { sum += v[0]; return true; });
+        double expected = 0;
+        plain.report(a, b, [&expected](const V& v) { expected += v[0]; return true; });
+        assert(abs(sum - expected) < 1e-9);
+      }
+    }));
+
+    const C counter(data);
+    for (int q = 0; q < 1000; ++q) {
+      Box<Dim> box;
+      tie(box.lo, box.hi) = randomBox();
+      box.closed = q % 2;
+      double sum = 0, expected = 0;
+      int count = 0;
+      ranked.report(box, [&sum](const V& v) { sum += v[0]; return true; });
+      plain.report(box, [&](const V& v) { expected += v[0]; ++count; return true; });
+      assert(abs(sum - expected) < 1e-9);
+      assert(counter.query(box) == count);
+    }
+  }
+}
+
+// Max, count and report of trees with buckets, every one against all the points within the box
+template<size_t Dim, size_t Bucket>
+void testBucket(size_t n) {
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, MaxValueTrans<Dim>, Bucket>;
+  using C = ORT<Dim, V, DimCmpSingle<Dim+1>, CountOnly, EmptyTrans<V>, Bucket>;
+  using P = ORT<Dim, V, DimCmpSingle<Dim+1>, ReportOnly, EmptyTrans<V>, Bucket>;
+  std::cout << "  Bucket = " << Bucket << std::endl;
+  vector<V> data = randomPoints<Dim+1>(n);
+
+  const O tree = timer("   Constructing tree", function<O()>([&data] {
+    return O(data);
+  }));
+  const C counter(data);
+  const P reporter(data);
+  std::cout << "   Bytes: " << tree.bytes() << ", counting: " << counter.bytes() << ", reporting: "
+            << reporter.bytes() << endl;
+
+  vector<pair<V, V>> queries;
+  const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+  for (int q = 0; q < 1000; ++q)
+    queries.push_back(randomBox());
+  vector<pair<bool, V>> found(queries.size());
+  timer("   1000 queries (expected 100 points)", function<void()>([&] {
+    for (size_t q = 0; q < queries.size(); ++q)
+      found[q].second = tree.query(queries[q].first, queries[q].second, found[q].first);
+  }));
+
+  for (size_t q = 0; q < queries.size(); ++q) {
+    const V& a = queries[q].first;
+    const V& b = queries[q].second;
+    vector<V> inside;
+    for (const V& p : data)
+      if (within<Dim>(p, a, b)) inside.push_back(p);
+    assert(found[q].first == !inside.empty());
+    assert(!found[q].first ||
+           found[q].second[Dim] == (*min_element(inside.begin(), inside.end(), GreaterValue<Dim>{}))[Dim]);
+    bool any;
+    assert(counter.query(a, b, any) == int(inside.size()));
+    vector<V> reported;
+    reporter.report(a, b, [&reported](const V& v) { reported.push_back(v); return true; });
+    sort(inside.begin(), inside.end());
+    sort(reported.begin(), reported.end());
+    assert(reported == inside);
+  }
+}
+
+// Structures of up to Bucket elements scanned instead of built
+// The masks of bucket scans, by clipColumn - with SIMD, where the target has it - against the scalar
+// loop: over coordinates with many ties with the bounds, and NaNs, of every count and alignment
+void testClipColumn() {
+  const double nan = numeric_limits<double>::quiet_NaN();
+  for (int q = 0; q < 100000; ++q) {
+    double c[40];
+    for (double& x : c)
+      x = rand() % 17 ? rand() % 8 : nan;
+    const int from = rand() % 8, count = rand() % (40 - from + 1);
+    const double lo = rand() % 8, hi = rand() % 8;
+    const bool aInclusive = rand() % 2, bInclusive = rand() % 2;
+    uint8_t in[40], scalar[40];
+    for (int i = 0; i < count; ++i)
+      in[i] = scalar[i] = rand() % 4 != 0;
+    clipColumn(c + from, count, lo, aInclusive, hi, bInclusive, in);
+    clipColumnScalar(c + from, count, lo, aInclusive, hi, bInclusive, scalar);
+    assert(equal(in, in + count, scalar));
+  }
+}
+
+template<size_t Dim>
+void testBuckets(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = max, with buckets: " << std::endl;
+  testClipColumn();
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    testBucket<Dim, 0>(n);
+    testBucket<Dim, 8>(n);
+    testBucket<Dim, 32>(n);
+    testBucket<Dim, 128>(n);
+  }
+}
+
+// The last level as a table - for Mix declared idempotent or invertible - against a GSegTree
+template<size_t Dim, class Mix>
+void testTables(const string& label, const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = " << label << ", last level as a table: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, Mix, EmptyTrans<V>>;
+  using S = ORT<Dim, V, DimCmpSingle<Dim+1>, Updatable<Mix>, EmptyTrans<V>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+    for (V& v : data)
+      v[Dim] = rand() % 1000;  // So that sums are exact
+    const O tree(data);
+    const S segTree(data);
+    std::cout << "  Bytes: " << tree.bytes() << ", with GSegTrees: " << segTree.bytes() << endl;
+
+    vector<pair<V, V>> queries;
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(1000./n, 1./Dim)};
+    for (int q = 0; q < 10000; ++q) {
+      V a, b;
+      tie(a, b) = randomBox();
+      for (size_t x = 0; x<Dim; ++x)  // Sides at random up to dx
+        b[x] = a[x] + (static_cast<double>(rand())/RAND_MAX) * randomBox.dx;
+      queries.emplace_back(a, b);
+    }
+    double sum = 0, expected = 0;
+    timer("  10000 queries (up to 1000 points)", function<void()>([&] {
+      for (const auto& q : queries) {
+        bool any;
+        const V v = tree.query(q.first, q.second, any);
+        if (any) sum += v[Dim];
+      }
+    }));
+    timer("  10000 queries with GSegTrees", function<void()>([&] {
+      for (const auto& q : queries) {
+        bool any;
+        const V v = segTree.query(q.first, q.second, any);
+        if (any) expected += v[Dim];
+      }
+    }));
+    assert(sum == expected);
+  }
+}
+
+// RangeIndex taking ORT while it fits in the budget, KDTree beyond, checked against KDTree
+template<size_t Dim>
+void testRangeIndex(const std::initializer_list<size_t>& ns, size_t budget) {
+  std::cout << "RangeIndex " << Dim << "D with Mix = max, budget of " << budget << " bytes: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using I = RangeIndex<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, MaxValueTrans<Dim>>;
+  using K = KDTree<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+
+    const I index = timer("  Constructing index", function<I()>([&data, budget] {
+      return I(data, budget);
+    }));
+    std::cout << "  Engine: " << (index.engine() == I::Engine::ORT ? "ORT" : "KDTree")
+              << ", bytes: " << index.bytes() << endl;
+    const K kd = timer("  Constructing KDTree", function<K()>([&data] {
+      return K(data);
+    }));
+    std::cout << "  KDTree bytes: " << kd.bytes() << endl;
+
+    vector<pair<V, V>> queries;
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(100./n, 1./Dim)};
+    for (int q = 0; q < 1000; ++q)
+      queries.push_back(randomBox());
+    vector<V> found, expected;
+    timer("  1000 queries (expected 100 points)", function<void()>([&] {
+      for (const auto& q : queries) {
+        bool any;
+        const V v = index.query(q.first, q.second, any);
+        if (any) found.push_back(v);
+      }
+    }));
+    timer("  1000 queries with KDTree", function<void()>([&] {
+      for (const auto& q : queries) {
+        bool any;
+        const V v = kd.query(q.first, q.second, any);
+        if (any) expected.push_back(v);
+      }
+    }));
+    assert(found.size() == expected.size());
+    for (size_t i = 0; i < found.size(); ++i)
+      assert(found[i][Dim] == expected[i][Dim]);
+  }
+}
+
+// Queries within Boxes against the same ones within V bounds, made as QueryPointCreatorInVec does;
+// and closed Boxes against half-open ones one past them, over integer coordinates
+template<size_t Dim>
+void testBoxes(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D within boxes: " << std::endl;
+  using V = vector<NDPoint<Dim>>;
+  using O = ORT<Dim, V, DimCmpInVec<Dim>, ReportOnly, EmptyTrans<V>>;
+  using P = NDPoint<Dim>;
+  using C = ORT<Dim, P, DimCmpSingle<Dim>, CountOnly, EmptyTrans<P>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data;
+    vector<P> grid;
+    for (size_t i = 0; i < n; ++i) {
+      data.push_back(RandomPointCreatorInVec<Dim>{}());
+      grid.push_back(RandomPointCreator<Dim>{}());
+      for (auto& x : grid.back()) x = floor(x * 100);
+    }
+    const O tree(data);
+    const C counter(grid);
+
+    vector<Box<Dim>> boxes(10000);
+    const RandomBoxCreator<Dim> randomBox{std::pow(100./n, 1./Dim)};
+    for (auto& box : boxes)
+      tie(box.lo, box.hi) = randomBox();
+    size_t found = 0, expected = 0;
+    timer("  10000 reports within V bounds (expected 100 points)", function<void()>([&] {
+      for (const auto& box : boxes)
+        tree.report(QueryPointCreatorInVec<Dim>{}(box.lo), QueryPointCreatorInVec<Dim>{}(box.hi),
+                    [&expected](const V&) { ++expected; return true; });
+    }));
+    timer("  10000 reports within boxes", function<void()>([&] {
+      for (const auto& box : boxes)
+        tree.report(box, [&found](const V&) { ++found; return true; });
+    }));
+    assert(found == expected);
+
+    for (auto& box : boxes) {
+      for (size_t x = 0; x<Dim; ++x) {
+        box.lo[x] = floor(box.lo[x] * 100);
+        box.hi[x] = floor(box.hi[x] * 100);
+      }
+      Box<Dim> closed = box;
+      closed.closed = true;
+      for (auto& x : box.hi) ++x;
+      assert(counter.query(closed) == counter.query(box));
+    }
+  }
+}
+
+// Whether top holds the k best of all, by value: ties may come in any order, but each element once
+template<size_t Dim>
+bool isTop(vector<NDPoint<Dim+1>> top, vector<NDPoint<Dim+1>> all, size_t k) {
+  sort(all.begin(), all.end(), GreaterValue<Dim>{});
+  if (top.size() != min(k, all.size())) return false;
+  for (size_t i = 0; i < top.size(); ++i)
+    if (top[i][Dim] != all[i][Dim]) return false;
+  sort(top.begin(), top.end());
+  sort(all.begin(), all.end());
+  return adjacent_find(top.begin(), top.end()) == top.end() && includes(all.begin(), all.end(), top.begin(), top.end());
+}
+
+// The 10 best within boxes of about 10000 points, of 100 values - so with plenty of ties - with a
+// table and with GSegTrees at the last level, against all that report() gives; then again with the
+// 5 best of every box erased
+template<size_t Dim>
+void testTop(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D top 10 with Mix = max: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, EmptyTrans<V>>;
+  using S = ORT<Dim, V, DimCmpSingle<Dim+1>, Updatable<MaxValueMix<Dim>>, MaxValueTrans<Dim>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+    for (V& v : data)
+      v[Dim] = rand() % 100;
+    const O tree(data);
+    S segTree(data);
+
+    vector<pair<V, V>> queries;
+    const RandomBoxCreator<Dim, V> randomBox{std::pow(min(1., 10000./n), 1./Dim)};
+    for (int q = 0; q < 100; ++q)
+      queries.push_back(randomBox());
+    vector<vector<V>> found, foundSeg, all;
+    timer("  100 top 10", function<void()>([&] {
+      for (const auto& q : queries)
+        found.push_back(tree.template top<GreaterValue<Dim>>(q.first, q.second, 10));
+    }));
+    timer("  100 top 10 with GSegTrees", function<void()>([&] {
+      for (const auto& q : queries)
+        foundSeg.push_back(segTree.template top<GreaterValue<Dim>>(q.first, q.second, 10));
+    }));
+    timer("  100 reports, sorted", function<void()>([&] {
+      for (const auto& q : queries) {
+        vector<V> inside;
+        tree.report(q.first, q.second, [&inside](const V& v) { inside.push_back(v); return true; });
+        sort(inside.begin(), inside.end(), GreaterValue<Dim>{});
+        all.push_back(inside);
+      }
+    }));
+    for (size_t q = 0; q < queries.size(); ++q) {
+      assert(isTop<Dim>(found[q], all[q], 10));
+      assert(isTop<Dim>(foundSeg[q], all[q], 10));
+    }
+
+    for (const auto& best : found)
+      for (size_t i = 0; i < best.size() && i < 5; ++i)
+        segTree.erase(best[i]);
+    for (const auto& q : queries) {
+      vector<V> inside;
+      segTree.report(q.first, q.second, [&inside](const V& v) { inside.push_back(v); return true; });
+      assert(isTop<Dim>(segTree.template top<GreaterValue<Dim>>(q.first, q.second, 10), inside, 10));
+    }
+  }
+}
+
+// Keys searched in Eytzinger order find what sorted ones do, in trees of every kind, with buckets too
+template<size_t Dim>
+void testLayouts(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with keys in Eytzinger order: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using Cmp = DimCmpSingle<Dim+1>;
+  using E = EmptyTrans<V>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data;
+    for (size_t i = 0; i < n; ++i)  // Every tenth a duplicate
+      data.push_back(i % 10 == 9 ? data.back() : RandomPointCreator<Dim+1>{}());
+
+    const ORT<Dim, V, Cmp, MaxValueMix<Dim>, E> maxSorted(data);
+    const ORT<Dim, V, Cmp, MaxValueMix<Dim>, E, 0, EytzingerKeys> maxEytzinger(data);
+    const ORT<Dim, V, Cmp, MaxValueMix<Dim>, E, 8> bucketSorted(data);
+    const ORT<Dim, V, Cmp, MaxValueMix<Dim>, E, 8, EytzingerKeys> bucketEytzinger(data);
+    const ORT<Dim, V, Cmp, CountOnly, E, 0, EytzingerKeys> counting(data);
+    const ORT<Dim, V, Cmp, ReportOnly, E, 0, EytzingerKeys> reporting(data);
+    assert(maxEytzinger.bytes() > maxSorted.bytes());
+    assert(maxEytzinger.stats().bytes == maxEytzinger.bytes());
+    assert(counting.stats().bytes == counting.bytes());
+
+    for (int q = 0; q < 1000; ++q) {
+      Box<Dim> box;
+      tie(box.lo, box.hi) = RandomBoxCreator<Dim>{0.1}();
+      box.closed = q % 2;
+      bool any, eytzingerAny;
+      const V v = maxSorted.query(box, any);
+      const V w = maxEytzinger.query(box, eytzingerAny);
+      assert(any == eytzingerAny);
+      assert(!any || v[Dim] == w[Dim]);
+      const V bv = bucketSorted.query(box, any);
+      const V bw = bucketEytzinger.query(box, eytzingerAny);
+      assert(any == eytzingerAny);
+      assert(!any || bv[Dim] == bw[Dim]);
+
+      vector<V> inside;
+      for (const V& p : data)
+        if (within<Dim>(p, box.lo, box.hi, box.closed)) inside.push_back(p);
+      assert(counting.query(box) == int(inside.size()));
+      vector<V> reported;
+      reporting.report(box, [&reported](const V& p) { reported.push_back(p); return true; });
+      sort(inside.begin(), inside.end());
+      sort(reported.begin(), reported.end());
+      assert(reported == inside);
+    }
+  }
+}
+
+void printStats(const ORTStats& stats) {
+  std::cout << "   Bytes: " << stats.bytes << ", allocations: " << stats.allocations << endl;
+  for (size_t i = stats.levels.size(); i--;) {
+    const ORTLevelStats& l = stats.levels[i];
+    std::cout << "   Dim " << i << ": " << l.structures << " structures, " << l.buckets << " buckets, "
+              << l.elements << " elements, " << l.nodes << " nodes; bytes of keys " << l.keyBytes
+              << ", values " << l.valueBytes << ", trans " << l.transBytes << ", holes " << l.holeBytes
+              << ", cascade " << l.cascadeBytes << ", padding " << l.paddingBytes << endl;
+  }
+}
+
+// Stats of built trees, and estimates for ten times as many elements
+template<size_t Dim>
+void testStats(const std::initializer_list<size_t>& ns) {
+  std::cout << "ORT " << Dim << "D with Mix = max, stats: " << std::endl;
+  using V = NDPoint<Dim+1>;
+  using O = ORT<Dim, V, DimCmpSingle<Dim+1>, MaxValueMix<Dim>, MaxValueTrans<Dim>>;
+  for (size_t n : ns) {
+    std::cout << " N = " << n << std::endl;
+    vector<V> data = randomPoints<Dim+1>(n);
+    const O tree(data);
+    const ORTStats stats = tree.stats();
+    assert(stats.bytes == tree.bytes());
+    std::cout << "  Built:" << endl;
+    printStats(stats);
+    std::cout << "  Estimated for N = " << n*10 << ":" << endl;
+    printStats(O::stats(n*10));
+  }
+}
+
 template<size_t Dim>
 struct GoGuiVisualizer;
 
@@ -307,7 +1362,7 @@ struct GoGuiVisualizer<2> {
 };
 
 void demo() {  
-  using O = ORT<2, vector<NDPoint<2>>, DimCmpInVec<2>, SumOfPointsTrans<2>>;
+  using O = ORT<2, vector<NDPoint<2>>, DimCmpInVec<2>, SumOfPointsMix<2>, SumOfPointsTrans<2>>;
   
   gogui::vector<gogui::Point> points;
   vector<vector<NDPoint<2>>> pts;
@@ -331,7 +1386,7 @@ void demo() {
     gogui::ActiveLine al1{l1}, al2{l2}, al3{l3}, al4{l4};
     gogui::snapshot("Request");
     
-    O tree(pts, SumOfPointsMix<2>{});
+    O tree(pts);
     bool any;
     {
       GoGuiVisualizer<2> viz{points};
@@ -357,4 +1412,70 @@ int main(int argc, char** argv) {
   testConstructionForMax<3>({10, 100, 1000, 10000, 100000});
   testConstructionForMax<4>({10, 100, 1000, 10000});
   testConstructionForMax<5>({10, 100, 1000});
+
+  testConstructionForUpdatableMax<2>({10, 1000, 100000});
+  testConstructionForUpdatableMax<3>({10, 1000, 10000});
+
+  testReporting<2>({1000, 100000, 1000000});
+  testReporting<3>({1000, 100000});
+
+  testCounting<2>({1000, 100000, 1000000});
+  testCounting<3>({1000, 100000});
+
+  testDynamic<2>({1000, 10000, 100000});
+  testDynamic<3>({1000, 10000});
+
+  testErase<1>({1000, 100000});
+  testErase<2>({1000, 100000});
+  testErase<3>({1000, 10000});
+
+  testApply<1>({1000, 100000});
+  testApply<2>({1000, 100000});
+  testApply<3>({1000, 10000});
+
+  testConcurrentQueries<2>({1000, 10000});
+
+  testSnapshots<2>({1000, 100000});
+
+  testFile<2>({1000, 100000});
+  testFile<3>({1000, 10000});
+  testMapLarge();
+
+  testExternalSort(1000000);
+  testExternalBuild<1>({1000, 1000000});
+  testExternalBuild<2>({1000, 100000});
+  testExternalBuild<3>({1000, 10000});
+
+  testRankSpace<2, uint16_t>({1000, 50000});
+  testRankSpace<2, uint32_t>({1000, 100000, 1000000});
+  testRankSpace<3, uint32_t>({1000, 100000});
+
+  testBuckets<2>({1000, 100000});
+  testBuckets<3>({1000, 10000});
+  testBuckets<4>({1000, 5000});
+  testBuckets<5>({1000});
+
+  testTables<1, MaxValueMix<1>>("max", {1000, 1000000});
+  testTables<2, MaxValueMix<2>>("max", {1000, 100000});
+  testTables<3, MaxValueMix<3>>("max", {1000, 10000});
+  testTables<2, SumOfValuesMix<2>>("sum", {1000, 100000});
+  testTables<3, SumOfValuesMix<3>>("sum", {1000, 10000});
+
+  testRangeIndex<2>({1000, 1000000}, size_t(1) << 30);
+  testRangeIndex<4>({1000, 1000000}, size_t(1) << 30);
+  testRangeIndex<5>({1000, 1000000}, size_t(1) << 30);
+
+  testStats<2>({1000, 100000});
+  testStats<3>({1000, 10000});
+
+  testLayouts<1>({1000, 100000});
+  testLayouts<2>({1000, 30000});
+  testLayouts<3>({1000, 5000});
+
+  testBoxes<2>({1000, 100000});
+  testBoxes<3>({1000, 100000});
+
+  testTop<1>({1000, 1000000});
+  testTop<2>({1000, 1000000});
+  testTop<3>({1000, 100000});
 }